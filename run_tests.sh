@@ -6,7 +6,8 @@ usage() {
     echo "Usage: $0 <executable>"
     echo
     echo "Runs all tests in the 'tests' directory against the given executable."
-    echo "The executable should be located at ./build/bin/<executable>"
+    echo "The executable should be located at ./build/bin/<executable>, or in"
+    echo "\$BIN_DIR if set. Exits with status 1 if a test fails."
     exit 1
 }
 
@@ -22,6 +23,10 @@ NC='\033[0m'
 
 # Test directory
 TEST_DIR="tests"
+BIN_DIR="${BIN_DIR:-./build/bin}"
+
+# Number of failed tests
+FAILED=0
 
 # Function to run a test
 
@@ -29,6 +34,7 @@ run_test() {
     local input_file="$1"
     local expected_output="$2"
     local test_name="$3"
+    local flags="$4"
 
     tmp_output=$(mktemp)
     tmp_stats=$(mktemp)
@@ -36,8 +42,19 @@ run_test() {
 
     echo "Running test: $test_name"
 
+    if [ ! -f "$expected_output" ]; then
+        echo "- Test skipped: $test_name (no expected output)"
+        rm $tmp_output $tmp_stats $tmp_diff
+        return
+    fi
+
     # Run the program and measure time + memory
-    /usr/bin/time -f "%e %M" -o "$tmp_stats" ./build/bin/$EXECUTABLE < "$input_file" > "$tmp_output"
+    if [ -x /usr/bin/time ]; then
+        /usr/bin/time -f "%e %M" -o "$tmp_stats" $BIN_DIR/$EXECUTABLE $flags < "$input_file" > "$tmp_output"
+    else
+        echo "- -" > "$tmp_stats"
+        $BIN_DIR/$EXECUTABLE $flags < "$input_file" > "$tmp_output"
+    fi
     read elapsed_s mem_kb < $tmp_stats
 
     # Compare output
@@ -45,6 +62,7 @@ run_test() {
         echo -e "${GREEN}✓ Test passed: $test_name${NC} (Time: ${elapsed_s}s, Memory: ${mem_kb}KB)"
     else
         echo -e "${RED}✗ Test failed: $test_name${NC} (Time: ${elapsed_s}s, Memory: ${mem_kb}KB)"
+        FAILED=$((FAILED + 1))
         echo "Differences:"
         diff $tmp_output $expected_output > /dev/null
     fi
@@ -52,28 +70,135 @@ run_test() {
     rm $tmp_output $tmp_stats $tmp_diff
 }
 
-# Run slide test
-run_test "$TEST_DIR/slide.txt" "$TEST_DIR/slide.output.txt" "Slide Test"
-run_test "$TEST_DIR/insert.txt" "$TEST_DIR/insert.output.txt" "Insert Test"
-run_test "$TEST_DIR/test1.txt" "$TEST_DIR/test1.output.txt" "Test 1"
-run_test "$TEST_DIR/test2.txt" "$TEST_DIR/test2.output.txt" "Test 2"
-run_test "$TEST_DIR/test3.txt" "$TEST_DIR/test3.output.txt" "Test 3"
-run_test "$TEST_DIR/input_SL001.txt" "$TEST_DIR/input_SL001.output.txt" "Input SL001"
-run_test "$TEST_DIR/input_IN001.txt" "$TEST_DIR/input_IN001.output.txt" "Input IN001"
-run_test "$TEST_DIR/input_HS001.txt" "$TEST_DIR/input_HS001.output.txt" "Input HS001"
-run_test "$TEST_DIR/input_HS002.txt" "$TEST_DIR/input_HS002.output.txt" "Input HS002"
-run_test "$TEST_DIR/input_HS003.txt" "$TEST_DIR/input_HS003.output.txt" "Input HS003"
-run_test "$TEST_DIR/input_HS004.txt" "$TEST_DIR/input_HS004.output.txt" "Input HS004"
-run_test "$TEST_DIR/input_HS005.txt" "$TEST_DIR/input_HS005.output.txt" "Input HS005"
-run_test "$TEST_DIR/input_HS006.txt" "$TEST_DIR/input_HS006.output.txt" "Input HS006"
-run_test "$TEST_DIR/input_HS007.txt" "$TEST_DIR/input_HS007.output.txt" "Input HS007"
-run_test "$TEST_DIR/input_HS008.txt" "$TEST_DIR/input_HS008.output.txt" "Input HS008"
-run_test "$TEST_DIR/input_HS009.txt" "$TEST_DIR/input_HS009.output.txt" "Input HS009"
-run_test "$TEST_DIR/input_HS010.txt" "$TEST_DIR/input_HS010.output.txt" "Input HS010"
-run_test "$TEST_DIR/input_HS011.txt" "$TEST_DIR/input_HS011.output.txt" "Input HS011"
-run_test "$TEST_DIR/input_HS012.txt" "$TEST_DIR/input_HS012.output.txt" "Input HS012"
-run_test "$TEST_DIR/input_HS013.txt" "$TEST_DIR/input_HS013.output.txt" "Input HS013"
-run_test "$TEST_DIR/input_HS014.txt" "$TEST_DIR/input_HS014.output.txt" "Input HS014"
+# Function to record an input and replay it: the replay must match the
+# recorded output, and fail once a byte of it is corrupted
+
+run_replay_test() {
+    local input_file="$1"
+    local test_name="$2"
+
+    tmp_log=$(mktemp)
+    tmp_report=$(mktemp)
+
+    echo "Running test: $test_name"
+
+    $BIN_DIR/$EXECUTABLE --record "$tmp_log" < "$input_file" > /dev/null
+    if ! $BIN_DIR/$EXECUTABLE --replay "$tmp_log" > /dev/null 2> "$tmp_report" ||
+        ! grep -q "output matches" "$tmp_report"; then
+        echo -e "${RED}✗ Test failed: $test_name${NC} (replay does not match)"
+        FAILED=$((FAILED + 1))
+        cat "$tmp_report"
+    else
+        # the recorded output ends the log: replace its last byte (a newline)
+        size=$(stat -c %s "$tmp_log")
+        printf 'X' | dd of="$tmp_log" bs=1 seek=$((size - 1)) conv=notrunc 2> /dev/null
+        if $BIN_DIR/$EXECUTABLE --replay "$tmp_log" > /dev/null 2>&1; then
+            echo -e "${RED}✗ Test failed: $test_name${NC} (corrupted output not detected)"
+            FAILED=$((FAILED + 1))
+        else
+            echo -e "${GREEN}✓ Test passed: $test_name${NC}"
+        fi
+    fi
+
+    rm $tmp_log $tmp_report
+}
+
+# Function to run an input with --stats and compare the report printed on
+# stderr, without its page faults (which depend on the machine)
+
+run_stats_test() {
+    local input_file="$1"
+    local expected_output="$2"
+    local expected_report="$3"
+    local test_name="$4"
+
+    tmp_output=$(mktemp)
+    tmp_report=$(mktemp)
+
+    echo "Running test: $test_name"
+
+    $BIN_DIR/$EXECUTABLE --stats < "$input_file" > "$tmp_output" 2> "$tmp_report"
+    if ! diff -q $tmp_output "$expected_output" > /dev/null; then
+        echo -e "${RED}✗ Test failed: $test_name${NC} (output differs)"
+        FAILED=$((FAILED + 1))
+    elif ! grep -v "^page faults:" "$tmp_report" | diff - "$expected_report"; then
+        echo -e "${RED}✗ Test failed: $test_name${NC} (report differs)"
+        FAILED=$((FAILED + 1))
+    else
+        echo -e "${GREEN}✓ Test passed: $test_name${NC}"
+    fi
+
+    rm $tmp_output $tmp_report
+}
+
+# Function to run the tests whose output does not depend on the options, with
+# the given options (and suffix for their names)
+
+run_suite() {
+    local flags="$1"
+    local suffix="$2"
+
+    # Run slide test
+    run_test "$TEST_DIR/slide.txt" "$TEST_DIR/slide.output.txt" "Slide Test$suffix" "$flags"
+    run_test "$TEST_DIR/insert.txt" "$TEST_DIR/insert.output.txt" "Insert Test$suffix" "$flags"
+    run_test "$TEST_DIR/dawg_insert.txt" "$TEST_DIR/dawg_insert.output.txt" "DAWG Insert Test$suffix" "$flags"
+    run_test "$TEST_DIR/compact.txt" "$TEST_DIR/compact.output.txt" "Compact Test$suffix" "$flags"
+    run_test "$TEST_DIR/filter_cache.txt" "$TEST_DIR/filter_cache.output.txt" "Filter Cache Test$suffix" "--filter-cache 16 $flags"
+    run_test "$TEST_DIR/test1.txt" "$TEST_DIR/test1.output.txt" "Test 1$suffix" "$flags"
+    run_test "$TEST_DIR/test2.txt" "$TEST_DIR/test2.output.txt" "Test 2$suffix" "$flags"
+    run_test "$TEST_DIR/test3.txt" "$TEST_DIR/test3.output.txt" "Test 3$suffix" "$flags"
+    run_test "$TEST_DIR/input_SL001.txt" "$TEST_DIR/input_SL001.output.txt" "Input SL001$suffix" "$flags"
+    run_test "$TEST_DIR/input_IN001.txt" "$TEST_DIR/input_IN001.output.txt" "Input IN001$suffix" "$flags"
+    run_test "$TEST_DIR/input_NL001.txt" "$TEST_DIR/input_NL001.output.txt" "Input NL001$suffix" "$flags"
+    run_test "$TEST_DIR/input_HS001.txt" "$TEST_DIR/input_HS001.output.txt" "Input HS001$suffix" "$flags"
+    run_test "$TEST_DIR/input_HS002.txt" "$TEST_DIR/input_HS002.output.txt" "Input HS002$suffix" "$flags"
+    run_test "$TEST_DIR/input_HS003.txt" "$TEST_DIR/input_HS003.output.txt" "Input HS003$suffix" "$flags"
+    run_test "$TEST_DIR/input_HS004.txt" "$TEST_DIR/input_HS004.output.txt" "Input HS004$suffix" "$flags"
+    run_test "$TEST_DIR/input_HS005.txt" "$TEST_DIR/input_HS005.output.txt" "Input HS005$suffix" "$flags"
+    run_test "$TEST_DIR/input_HS006.txt" "$TEST_DIR/input_HS006.output.txt" "Input HS006$suffix" "$flags"
+    run_test "$TEST_DIR/input_HS007.txt" "$TEST_DIR/input_HS007.output.txt" "Input HS007$suffix" "$flags"
+    run_test "$TEST_DIR/input_HS008.txt" "$TEST_DIR/input_HS008.output.txt" "Input HS008$suffix" "$flags"
+    run_test "$TEST_DIR/input_HS009.txt" "$TEST_DIR/input_HS009.output.txt" "Input HS009$suffix" "$flags"
+    run_test "$TEST_DIR/input_HS010.txt" "$TEST_DIR/input_HS010.output.txt" "Input HS010$suffix" "$flags"
+    run_test "$TEST_DIR/input_HS011.txt" "$TEST_DIR/input_HS011.output.txt" "Input HS011$suffix" "$flags"
+    run_test "$TEST_DIR/input_HS012.txt" "$TEST_DIR/input_HS012.output.txt" "Input HS012$suffix" "$flags"
+    run_test "$TEST_DIR/input_HS013.txt" "$TEST_DIR/input_HS013.output.txt" "Input HS013$suffix" "$flags"
+    run_test "$TEST_DIR/input_HS014.txt" "$TEST_DIR/input_HS014.output.txt" "Input HS014$suffix" "$flags"
+}
+
+run_suite "" ""
+# the dictionary as a minimal automaton gives the same answers
+run_suite "--dawg" " (--dawg)"
+# the dictionary in a file-backed arena (created and unlinked by the program)
+run_suite "--arena $(mktemp -u)" " (--arena)"
+
+# paging is not available with --dawg
+run_test "$TEST_DIR/paging.txt" "$TEST_DIR/paging.output.txt" "Paging Test"
+
+# HS001 prints enough strings (262144) to take the parallel path of
+# +stampa_filtrate (at least PARALLEL_PRINT_MIN of them)
+run_test "$TEST_DIR/input_HS001.txt" "$TEST_DIR/input_HS001.output.txt" "Input HS001 (--print-threads 4)" "--print-threads 4"
+
+run_replay_test "$TEST_DIR/input_HS001.txt" "Replay HS001"
+
+# shape of the trie (histograms and nodes pruned per depth) and of its arena
+run_stats_test "$TEST_DIR/stats.txt" "$TEST_DIR/stats.output.txt" "$TEST_DIR/stats.stats.txt" "Stats Test"
+
+# Readers of the trie concurrent with a batch of inserts (see ebr.h)
+if [ -x $BIN_DIR/ebr_stress ]; then
+    echo "Running test: EBR Stress"
+    if $BIN_DIR/ebr_stress; then
+        echo -e "${GREEN}✓ Test passed: EBR Stress${NC}"
+    else
+        echo -e "${RED}✗ Test failed: EBR Stress${NC}"
+        FAILED=$((FAILED + 1))
+    fi
+fi
 
 # Add more tests here as needed
-# run_test "$TEST_DIR/another_test.txt" "$TEST_DIR/another_test.output.txt" "Another Test" 
\ No newline at end of file
+# run_test "$TEST_DIR/another_test.txt" "$TEST_DIR/another_test.output.txt" "Another Test" 
+
+if [ $FAILED -gt 0 ]; then
+    echo -e "${RED}$FAILED test(s) failed${NC}"
+    exit 1
+fi
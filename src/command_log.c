@@ -0,0 +1,425 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "command_log.h"
+#include "trace.h"
+
+#define COMMAND_LOG_MAGIC "WCLOG"
+#define COMMAND_LOG_CHUNK 65536
+// when paced, the tokens are waited for by sleeping until this many
+// nanoseconds before their recorded time, then spinning (a sleep can wake up
+// tens of microseconds late, which would add up to the latencies)
+#define COMMAND_LOG_SPIN_NS 200000
+
+/*
+ * Log being recorded or replayed.
+ * Members:
+ * - bool replaying:          Whether the log is replayed
+ * - FILE *file:              Log being written (recording)
+ * - FILE *output:            Copy of the standard output, appended to the
+ *     log when closed (recording)
+ * - unsigned char *data:     Contents of the log (replaying), `size` bytes,
+ *     `pos` of them read
+ * - unsigned char const *expected: Recorded output (replaying),
+ *     `expected_size` bytes, `compared` of them compared so far
+ * - size_t mismatch:         Offset of the first byte of output differing from
+ *     the recorded one (SIZE_MAX if none)
+ * - size_t mismatch_line:    Line of that byte (from 1)
+ * - bool paced:              Whether tokens are issued at their recorded time
+ * - uint64_t origin:         Time the first token was read
+ * - uint64_t start:          Time the first command began (replaying), after
+ *     the dictionary was loaded
+ * - uint64_t last:           Time the last token was read (recording), or
+ *     recorded time of the last token relative to the first one (replaying)
+ * - uint64_t issued:         Time the last token was issued (replaying)
+ * - bool running:            Whether a command is running (replaying)
+ * - uint64_t *latencies:     Latency of each command in nanoseconds (count
+ *     and capacity in latencies_size and latencies_capacity)
+ * - int stdout_fd:           Original standard output
+ * - int pipe_fd:             Read end of the pipe the standard output goes to
+ * - thrd_t tee:              Thread draining the pipe
+ */
+struct command_log_t {
+  bool replaying;
+  FILE *file;
+  FILE *output;
+  unsigned char *data;
+  size_t size;
+  size_t pos;
+  unsigned char const *expected;
+  size_t expected_size;
+  size_t compared;
+  size_t mismatch;
+  size_t mismatch_line;
+  bool paced;
+  uint64_t origin;
+  uint64_t start;
+  uint64_t last;
+  uint64_t issued;
+  bool running;
+  uint64_t *latencies;
+  size_t latencies_size;
+  size_t latencies_capacity;
+  int stdout_fd;
+  int pipe_fd;
+  thrd_t tee;
+};
+
+static void write_varint(FILE *file, uint64_t value);
+/*
+ * Reads a varint from the log being replayed.
+ * Returns: false if the log ends in the middle of it
+ */
+static bool read_varint(command_log_t *log, uint64_t *value);
+/*
+ * Checks the structure of a log being replayed and locates the recorded
+ * output (without moving the read position).
+ * Returns: false if the log is corrupted
+ */
+static bool locate_output(command_log_t *log);
+/*
+ * Sends the standard output to a pipe drained by the tee thread.
+ * Returns: false on failure
+ */
+static bool start_tee(command_log_t *log);
+/*
+ * Copies what is written to the standard output to the original one, and to
+ * the log (recording) or compares it with the recorded output (replaying)
+ * (thrd_start_t).
+ */
+static int tee(void *arg);
+/*
+ * Compares a chunk of output with the recorded output.
+ */
+static void compare_output(command_log_t *log, char const *chunk,
+                           size_t size);
+static int compare_latencies(void const *a, void const *b);
+/*
+ * Returns: The latency at percentile p of the sorted latencies, in
+ *   microseconds
+ */
+static double percentile(command_log_t const *log, double p);
+
+command_log_t *command_log_record(char const *path) {
+  command_log_t *log = (command_log_t *)calloc(1, sizeof(command_log_t));
+
+  log->file = fopen(path, "wb");
+  log->output = tmpfile();
+  if (log->file == NULL || log->output == NULL || !start_tee(log)) {
+    if (log->file != NULL)
+      fclose(log->file);
+    if (log->output != NULL)
+      fclose(log->output);
+    free(log);
+    return NULL;
+  }
+
+  fputs(COMMAND_LOG_MAGIC, log->file);
+  fputc(COMMAND_LOG_VERSION, log->file);
+  return log;
+}
+
+command_log_t *command_log_replay(char const *path, bool paced) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return NULL;
+
+  command_log_t *log = (command_log_t *)calloc(1, sizeof(command_log_t));
+  log->replaying = true;
+  log->paced = paced;
+  log->mismatch = SIZE_MAX;
+
+  // the whole log is loaded: it is about as large as the input it records
+  size_t capacity = COMMAND_LOG_CHUNK, read_size;
+  log->data = (unsigned char *)malloc(capacity);
+  while ((read_size = fread(log->data + log->size, 1, capacity - log->size,
+                            file)) > 0) {
+    log->size += read_size;
+    if (log->size == capacity) {
+      capacity *= 2;
+      log->data = (unsigned char *)realloc(log->data, capacity);
+    }
+  }
+  fclose(file);
+
+  size_t header_size = strlen(COMMAND_LOG_MAGIC) + 1;
+  if (log->size < header_size ||
+      memcmp(log->data, COMMAND_LOG_MAGIC, header_size - 1) != 0 ||
+      log->data[header_size - 1] != COMMAND_LOG_VERSION ||
+      (log->pos = header_size, !locate_output(log)) || !start_tee(log)) {
+    free(log->data);
+    free(log);
+    return NULL;
+  }
+
+  return log;
+}
+
+bool command_log_read(command_log_t *log, char *token, size_t size) {
+  if (log == NULL || !log->replaying) {
+    // bounded scanf("%s")
+    char format[32];
+    snprintf(format, sizeof(format), "%%%zus", size - 1);
+    if (scanf(format, token) != 1)
+      return false;
+
+    if (log != NULL) {
+      uint64_t now = trace_now();
+      size_t length = strlen(token);
+      if (log->origin == 0)
+        log->origin = log->last = now;
+      write_varint(log->file, now - log->last);
+      write_varint(log->file, length);
+      fwrite(token, 1, length, log->file);
+      log->last = now;
+    }
+    return true;
+  }
+
+  uint64_t delay, length;
+  if (!read_varint(log, &delay) || !read_varint(log, &length) ||
+      length == 0 || length > log->size - log->pos)
+    return false;
+
+  size_t copied = length < size ? length : size - 1;
+  memcpy(token, log->data + log->pos, copied);
+  token[copied] = '\0';
+  log->pos += length;
+
+  log->last += delay;
+  if (log->origin == 0)
+    log->origin = trace_now() - log->last;
+  if (log->paced) {
+    // wait for the recorded time of the token, which is its issue time even
+    // if the previous commands ran late (the delay is part of the latency)
+    uint64_t due = log->origin + log->last;
+    if (due > COMMAND_LOG_SPIN_NS) {
+      uint64_t wake = due - COMMAND_LOG_SPIN_NS;
+      struct timespec until = {(time_t)(wake / 1000000000),
+                               (long)(wake % 1000000000)};
+      while (trace_now() < wake &&
+             clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) != 0)
+        ;
+    }
+    while (trace_now() < due)
+      ;
+    log->issued = due;
+  } else {
+    log->issued = trace_now();
+  }
+
+  return true;
+}
+
+void command_log_begin(command_log_t *log) {
+  if (log == NULL || !log->replaying)
+    return;
+
+  // the first token of the command was issued last
+  if (log->start == 0)
+    log->start = log->issued;
+  log->running = true;
+}
+
+void command_log_end(command_log_t *log) {
+  if (log == NULL || !log->replaying || !log->running)
+    return;
+
+  if (log->latencies_size == log->latencies_capacity) {
+    log->latencies_capacity =
+        log->latencies_capacity == 0 ? 1024 : 2 * log->latencies_capacity;
+    log->latencies = (uint64_t *)realloc(
+        log->latencies, log->latencies_capacity * sizeof(uint64_t));
+  }
+  // from the time the last token of the command was issued: a command is
+  // only complete, and its latency experienced, once all its tokens arrived
+  log->latencies[log->latencies_size++] = trace_now() - log->issued;
+  log->running = false;
+}
+
+bool command_log_close(command_log_t *log, FILE *report) {
+  bool ok = true;
+  uint64_t end = trace_now();
+
+  // restore the standard output, so that the tee thread reaches the end of
+  // the pipe
+  fflush(stdout);
+  dup2(log->stdout_fd, STDOUT_FILENO);
+  thrd_join(log->tee, NULL);
+  close(log->stdout_fd);
+  close(log->pipe_fd);
+
+  if (!log->replaying) {
+    char chunk[COMMAND_LOG_CHUNK];
+    size_t size;
+
+    write_varint(log->file, trace_now() - log->last);
+    write_varint(log->file, 0);
+    write_varint(log->file, (uint64_t)ftell(log->output));
+    rewind(log->output);
+    while ((size = fread(chunk, 1, sizeof(chunk), log->output)) > 0)
+      fwrite(chunk, 1, size, log->file);
+
+    ok = !ferror(log->file) && !ferror(log->output);
+    ok = fclose(log->file) == 0 && ok;
+    fclose(log->output);
+    free(log);
+    return ok;
+  }
+
+  // the throughput only covers the commands, not the dictionary load
+  uint64_t start = log->start == 0 ? end : log->start;
+  double load = log->origin == 0 ? 0 : (double)(start - log->origin) / 1e9;
+  double seconds = (double)(end - start) / 1e9;
+  qsort(log->latencies, log->latencies_size, sizeof(uint64_t),
+        compare_latencies);
+  fprintf(report,
+          "replay: dictionary loaded in %.3f s, %zu commands in %.3f s (%.0f "
+          "commands/s)\n",
+          load, log->latencies_size, seconds,
+          seconds > 0 ? log->latencies_size / seconds : 0.0);
+  if (log->latencies_size > 0)
+    fprintf(report,
+            "replay: latency p50 %.1f us, p90 %.1f us, p99 %.1f us, max "
+            "%.1f us\n",
+            percentile(log, 0.5), percentile(log, 0.9), percentile(log, 0.99),
+            percentile(log, 1));
+
+  if (log->mismatch == SIZE_MAX && log->compared < log->expected_size) {
+    log->mismatch = log->compared; // output shorter than the recorded one
+    log->mismatch_line = 1;
+    for (size_t i = 0; i < log->compared; i++)
+      log->mismatch_line += log->expected[i] == '\n';
+  }
+  if (log->mismatch == SIZE_MAX) {
+    fprintf(report, "replay: output matches the recorded one (%zu bytes)\n",
+            log->expected_size);
+  } else {
+    fprintf(report,
+            "replay: output differs from the recorded one at byte %zu (line "
+            "%zu)\n",
+            log->mismatch, log->mismatch_line);
+    ok = false;
+  }
+
+  free(log->latencies);
+  free(log->data);
+  free(log);
+  return ok;
+}
+
+void write_varint(FILE *file, uint64_t value) {
+  while (value >= 0x80) {
+    fputc((int)(value & 0x7f) | 0x80, file);
+    value >>= 7;
+  }
+  fputc((int)value, file);
+}
+
+bool read_varint(command_log_t *log, uint64_t *value) {
+  *value = 0;
+  for (unsigned shift = 0; shift < 64 && log->pos < log->size; shift += 7) {
+    unsigned char byte = log->data[log->pos++];
+    *value |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+bool locate_output(command_log_t *log) {
+  size_t start = log->pos;
+  uint64_t delay, length;
+
+  do {
+    if (!read_varint(log, &delay) || !read_varint(log, &length) ||
+        length > log->size - log->pos)
+      return false;
+    log->pos += length;
+  } while (length > 0);
+
+  if (!read_varint(log, &length) || length != log->size - log->pos)
+    return false;
+
+  log->expected = log->data + log->pos;
+  log->expected_size = length;
+  log->pos = start;
+  return true;
+}
+
+bool start_tee(command_log_t *log) {
+  int fds[2];
+
+  fflush(stdout);
+  if (pipe(fds) != 0)
+    return false;
+
+  log->stdout_fd = dup(STDOUT_FILENO);
+  log->pipe_fd = fds[0];
+  if (log->stdout_fd < 0 || dup2(fds[1], STDOUT_FILENO) < 0 ||
+      thrd_create(&log->tee, tee, log) != thrd_success) {
+    if (log->stdout_fd >= 0) {
+      dup2(log->stdout_fd, STDOUT_FILENO);
+      close(log->stdout_fd);
+    }
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+
+  close(fds[1]);
+  return true;
+}
+
+int tee(void *arg) {
+  command_log_t *log = (command_log_t *)arg;
+  char chunk[COMMAND_LOG_CHUNK];
+  ssize_t size;
+
+  while ((size = read(log->pipe_fd, chunk, sizeof(chunk))) > 0) {
+    for (ssize_t written = 0, n; written < size; written += n) {
+      n = write(log->stdout_fd, chunk + written, (size_t)(size - written));
+      if (n < 0)
+        break;
+    }
+
+    if (log->replaying)
+      compare_output(log, chunk, (size_t)size);
+    else
+      fwrite(chunk, 1, (size_t)size, log->output);
+  }
+
+  return 0;
+}
+
+void compare_output(command_log_t *log, char const *chunk, size_t size) {
+  for (size_t i = 0; i < size && log->mismatch == SIZE_MAX; i++) {
+    if (log->compared == log->expected_size ||
+        log->expected[log->compared] != (unsigned char)chunk[i]) {
+      log->mismatch = log->compared;
+      log->mismatch_line = 1;
+      for (size_t j = 0; j < log->compared; j++)
+        log->mismatch_line += log->expected[j] == '\n';
+    } else {
+      log->compared++;
+    }
+  }
+}
+
+int compare_latencies(void const *a, void const *b) {
+  uint64_t x = *(uint64_t const *)a, y = *(uint64_t const *)b;
+  return (x > y) - (x < y);
+}
+
+double percentile(command_log_t const *log, double p) {
+  size_t i = (size_t)(p * (double)(log->latencies_size - 1) + 0.5);
+  return (double)log->latencies[i] / 1000;
+}
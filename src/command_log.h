@@ -0,0 +1,91 @@
+#ifndef COMMAND_LOG_H
+#define COMMAND_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Command logs, to record a workload and replay it later.
+ *
+ * While recording, every token read from the standard input is appended to
+ * the log with the time elapsed since the previous one, and the standard
+ * output is copied to the end of the log (through a pipe drained by a
+ * thread). While replaying, the tokens are read from the log instead of the
+ * standard input, either as fast as possible or each at its recorded time,
+ * the latency of every command is measured (from the time its last token was
+ * issued when paced, from the time it was read otherwise, up to the time the
+ * next command is read), and the standard output is compared with the
+ * recorded one. When paced, a token is issued at its recorded time, not when
+ * the replay gets to it: the latency includes the time the previous commands
+ * ran late, but not the wake-up lag of the sleep waiting for the token (the
+ * last tenths of a millisecond are spun instead).
+ *
+ * Format (integers are LEB128 varints):
+ *   "WCLOG" COMMAND_LOG_VERSION
+ *   { delay_ns length token }    one record per token (length > 0)
+ *   delay_ns 0                   end of the input
+ *   output_size output
+ */
+#define COMMAND_LOG_VERSION 1
+
+typedef struct command_log_t command_log_t;
+
+/*
+ * Starts recording into a new log: from now on, the standard output is also
+ * copied to the log.
+ * Parameters:
+ * - char const *path: Path of the log
+ * Returns: Pointer to the log, NULL if it cannot be created
+ */
+command_log_t *command_log_record(char const *path);
+
+/*
+ * Starts replaying a log: from now on, the standard output is compared with
+ * the recorded one.
+ * Parameters:
+ * - char const *path: Path of the log
+ * - bool paced: Whether to issue each token at its recorded time (relative to
+ *     the first one) rather than as soon as it is read
+ * Returns: Pointer to the log, NULL if it cannot be read or is corrupted
+ */
+command_log_t *command_log_replay(char const *path, bool paced);
+
+/*
+ * Reads the next token (like scanf("%s")): from the standard input if log is
+ * NULL or recording, from the log if replaying.
+ * Parameters:
+ * - command_log_t *log: Pointer to the log, or NULL
+ * - char *token: Buffer receiving the token
+ * - size_t size: Size of the buffer (longer tokens are truncated if read from
+ *     a log, split if read from the standard input)
+ * Returns: false at the end of the input
+ */
+bool command_log_read(command_log_t *log, char *token, size_t size);
+
+/*
+ * Marks the beginning of a command, whose first token was the last one read
+ * (no-op if log is NULL or recording).
+ */
+void command_log_begin(command_log_t *log);
+
+/*
+ * Marks the end of the current command (no-op if log is NULL, recording, or
+ * no command is running).
+ */
+void command_log_end(command_log_t *log);
+
+/*
+ * Stops recording (writing the rest of the log) or replaying (printing the
+ * load time, the throughput of the commands, the latency percentiles and
+ * whether the output matched), and deallocates the log. The standard output
+ * goes back to its original file.
+ * Parameters:
+ * - command_log_t *log: Pointer to the log
+ * - FILE *report: File to print the report of a replay to
+ * Returns: false if recording failed or the replayed output differs
+ */
+bool command_log_close(command_log_t *log, FILE *report);
+
+#endif // COMMAND_LOG_H
@@ -9,3 +9,7 @@ const char *NEW_GAME = "+nuova_partita";
 const char *INSERT_START = "+inserisci_inizio";
 const char *INSERT_END = "+inserisci_fine";
 const char *PRINT_FILTERED = "+stampa_filtrate";
+const char *COMPACT = "+compatta";
+const char *PRINT_PAGE = "+stampa_pagina";
+const char *PRINT_PREFIX = "+stampa_prefisso";
+const char *RESUME = "+riprendi";
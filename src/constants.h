@@ -13,5 +13,9 @@ extern const char *NEW_GAME;
 extern const char *INSERT_START;
 extern const char *INSERT_END;
 extern const char *PRINT_FILTERED;
+extern const char *COMPACT;
+extern const char *PRINT_PAGE;
+extern const char *PRINT_PREFIX;
+extern const char *RESUME;
 
 #endif
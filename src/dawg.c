@@ -0,0 +1,664 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dawg.h"
+
+/*
+ * Strings read from the trie at a time while building an automaton from it.
+ */
+#define DAWG_RAX_CHUNK 64
+
+/*
+ * State being built: the states on the path of the last string added are
+ * kept apart until a string diverging from it is added, since only then
+ * their edges are known.
+ * Members:
+ * - size_t edges_size: Number of edges
+ * - char labels[]:     Label of each edge (increasing)
+ * - uint32_t targets[]: Target of each edge (the last one is a temporary
+ *     state, unless the state has been registered)
+ * - uint32_t runs_start[]: The characters of the chain of states skipped by
+ *     edge i are [runs_start[i], runs_start[i + 1]) in `runs_labels`
+ *     (edges_size + 1 entries); those of the last edge, which follow its
+ *     label in the last string added, are only copied once it is complete
+ *     (see dawg_builder_close)
+ * - char *runs_labels: Characters of the chains, `runs_capacity` bytes
+ */
+typedef struct dawg_temp_t {
+  size_t edges_size;
+  char labels[UINT8_MAX + 1];
+  uint32_t targets[UINT8_MAX + 1];
+  uint32_t runs_start[UINT8_MAX + 2];
+  size_t runs_capacity;
+  char *runs_labels;
+} dawg_temp_t;
+
+/*
+ * Incremental construction of the minimal automaton of sorted strings (Daciuk
+ * et al.): when a string is added, the states on the path of the previous one
+ * past the common prefix cannot change anymore, so they are replaced by the
+ * equivalent states already built, if any (looked up in `registry`, a hash
+ * table of states keyed by their edges), or registered themselves. A state
+ * with a single edge is skipped at first, the edge to it leading on to its
+ * target, and only registered (see dawg_builder_close) if the chain of such
+ * states is shorter than DAWG_MIN_RUN.
+ * Members:
+ * - dawg_t *dawg:           Automaton being built (registered states)
+ * - size_t states_capacity, edges_capacity, runs_capacity,
+ *     runs_labels_capacity: Capacities of its arrays
+ * - uint32_t *registry:     Open-addressing table of states + 1 (0 if empty)
+ * - size_t registry_capacity: Capacity of the table (power of 2)
+ * - char *last:             Last string added (k + 1 bytes)
+ * - dawg_temp_t single:     State with a single edge, of a short chain
+ * - dawg_temp_t path[]:     States on the path of the last string (k + 1)
+ */
+typedef struct dawg_builder_t {
+  dawg_t *dawg;
+  size_t states_capacity;
+  size_t edges_capacity;
+  size_t runs_capacity;
+  size_t runs_labels_capacity;
+  uint32_t *registry;
+  size_t registry_capacity;
+  char *last;
+  dawg_temp_t single;
+  dawg_temp_t path[];
+} dawg_builder_t;
+
+/*
+ * Allocates a builder of an automaton of strings of length k.
+ */
+static dawg_builder_t *dawg_builder_alloc(size_t k);
+
+/*
+ * Adds a string, greater than the previous ones.
+ */
+static void dawg_builder_add(dawg_builder_t *builder, char const *str);
+
+/*
+ * Completes the automaton and deallocates the builder.
+ * Returns: Pointer to the automaton
+ */
+static dawg_t *dawg_builder_finish(dawg_builder_t *builder);
+
+/*
+ * Replaces the temporary states of the path deeper than `depth` with
+ * registered ones, or skips them if they have a single edge.
+ */
+static void dawg_builder_minimize(dawg_builder_t *builder, size_t depth);
+
+/*
+ * Completes the last edge of the temporary state at a depth of the path:
+ * copies the characters of the chain it skips from the last string, or
+ * registers the states of the chain if it is shorter than DAWG_MIN_RUN.
+ */
+static void dawg_builder_close(dawg_builder_t *builder, size_t depth);
+
+/*
+ * Returns: The registered state equivalent to a temporary one, registering it
+ *   if there is none
+ */
+static uint32_t dawg_builder_register(dawg_builder_t *builder,
+                                      dawg_temp_t const *temp);
+
+/*
+ * Returns: Hash of the edge of a state (added to `hash`)
+ */
+static uint64_t dawg_hash(uint64_t hash, char label, char const *run,
+                          size_t run_size, uint32_t target);
+
+/*
+ * Returns: true if a string is accepted by the automaton (pending strings
+ *   aside)
+ */
+static bool dawg_accepts(dawg_t const *dawg, char const *str);
+
+/*
+ * Builds the automaton of the strings of another one plus its pending ones.
+ * Returns: Pointer to the new automaton, with no pending strings
+ */
+static dawg_t *dawg_rebuild(dawg_t const *dawg);
+
+/*
+ * Compares two strings (for qsort).
+ */
+static int dawg_compare(void const *a, void const *b);
+
+/*
+ * Yields the strings of an automaton in sorted order.
+ * Parameters:
+ * - dawg_t const *dawg: Pointer to the automaton
+ * - uint32_t *states, *edges: Stack of the states on the path and of the
+ *     edges taken from them (k + 1 entries each), states[0] is the root
+ * - size_t *depth: Number of edges on the stack, SIZE_MAX before the first
+ *     string
+ * - char *str: Path (k + 1 bytes), receiving the string
+ * Returns: false if there is no string left
+ */
+static bool dawg_next(dawg_t const *dawg, uint32_t *states, uint32_t *edges,
+                      size_t *depth, char *str);
+
+dawg_t *dawg_from_rax(memory_allocator_t const *allocator, rax_t const *root,
+                      size_t k) {
+  dawg_builder_t *builder = dawg_builder_alloc(k);
+  rax_iter_t *it = rax_iter_alloc(k);
+  char *words = (char *)malloc(DAWG_RAX_CHUNK * (k + 1));
+
+  // no filter equals (size_t)-1, so nothing is skipped
+  rax_iter_reset(it, (size_t)-1, "");
+  while (!rax_iter_done(it)) {
+    size_t n = rax_iter_next(allocator, root, it, words, DAWG_RAX_CHUNK);
+    for (size_t i = 0; i < n; i++)
+      dawg_builder_add(builder, words + i * (k + 1));
+  }
+
+  free(words);
+  rax_iter_dealloc(it);
+  return dawg_builder_finish(builder);
+}
+
+bool dawg_insert(dawg_t *dawg, char *strs, size_t count) {
+  size_t k = dawg->k, size = 0, i = 0, j = 0;
+
+  if (count == 0)
+    return false;
+
+  // merge the new strings into the pending ones
+  qsort(strs, count, k + 1, dawg_compare);
+  char *pending = (char *)malloc((dawg->pending_size + count) * (k + 1));
+  rax_epoch_t *pending_filter = (rax_epoch_t *)malloc(
+      (dawg->pending_size + count) * sizeof(rax_epoch_t));
+  while (i < dawg->pending_size || j < count) {
+    char const *old = dawg->pending + i * (k + 1), *str = strs + j * (k + 1);
+    int cmp = i == dawg->pending_size ? 1 : j == count ? -1 : strcmp(old, str);
+
+    // strings already in the dictionary are skipped
+    if (cmp == 0 ||
+        (cmp > 0 && ((j > 0 && strcmp(str, str - (k + 1)) == 0) ||
+                     dawg_accepts(dawg, str)))) {
+      j++;
+      continue;
+    }
+    // new strings are not pruned yet (they are checked while filtering)
+    pending_filter[size] = cmp < 0 ? dawg->pending_filter[i] : 0;
+    memcpy(pending + size++ * (k + 1), cmp < 0 ? old : str, k + 1);
+    if (cmp < 0)
+      i++;
+    else
+      j++;
+  }
+  free(dawg->pending);
+  free(dawg->pending_filter);
+  dawg->pending = pending;
+  dawg->pending_filter = pending_filter;
+  dawg->pending_size = size;
+
+  if (DAWG_PENDING_RATIO * dawg->pending_size <= dawg->strings)
+    return false;
+
+  dawg_t *rebuilt = dawg_rebuild(dawg);
+  free(dawg->pending);
+  free(dawg->pending_filter);
+  free(dawg->edges_start);
+  free(dawg->targets);
+  free(dawg->labels);
+  free(dawg->runs_start);
+  free(dawg->runs_target);
+  free(dawg->runs_labels);
+  free(dawg->unique);
+  free(dawg->filter);
+  *dawg = *rebuilt;
+  free(rebuilt);
+  return true;
+}
+
+bool dawg_search(dawg_t const *dawg, char const *str) {
+  if (dawg_accepts(dawg, str))
+    return true;
+
+  size_t lo = 0, hi = dawg->pending_size;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = strcmp(dawg->pending + mid * (dawg->k + 1), str);
+    if (cmp == 0)
+      return true;
+    if (cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return false;
+}
+
+size_t dawg_next_epoch(dawg_t *dawg, size_t game) {
+  if (game < RAX_MAX_EPOCH)
+    return game + 1;
+
+  memset(dawg->filter, 0, dawg->states_size * sizeof(rax_epoch_t));
+  if (dawg->pending_size > 0)
+    memset(dawg->pending_filter, 0, dawg->pending_size * sizeof(rax_epoch_t));
+  return 1;
+}
+
+size_t dawg_bytes(dawg_t const *dawg) {
+  return sizeof(dawg_t) +
+         dawg->states_size *
+             (sizeof(uint32_t) + sizeof(bool) + sizeof(rax_epoch_t)) +
+         sizeof(uint32_t) + dawg->edges_size * (sizeof(uint32_t) + 1) +
+         sizeof(uint32_t) + dawg->runs_size * 2 * sizeof(uint32_t) +
+         dawg->runs_start[dawg->runs_size] +
+         dawg->pending_size * (dawg->k + 1 + sizeof(rax_epoch_t));
+}
+
+void dawg_dealloc(dawg_t *dawg) {
+  free(dawg->pending);
+  free(dawg->pending_filter);
+  free(dawg->edges_start);
+  free(dawg->targets);
+  free(dawg->labels);
+  free(dawg->runs_start);
+  free(dawg->runs_target);
+  free(dawg->runs_labels);
+  free(dawg->unique);
+  free(dawg->filter);
+  free(dawg);
+}
+
+dawg_builder_t *dawg_builder_alloc(size_t k) {
+  dawg_builder_t *builder = (dawg_builder_t *)malloc(
+      sizeof(dawg_builder_t) + (k + 1) * sizeof(dawg_temp_t));
+  dawg_t *dawg = (dawg_t *)malloc(sizeof(dawg_t));
+
+  dawg->k = k;
+  dawg->strings = dawg->pending_size = dawg->states_size = dawg->edges_size = 0;
+  dawg->runs_size = 0;
+  dawg->pending = NULL;
+  dawg->pending_filter = NULL;
+  dawg->root = 0;
+  builder->states_capacity = builder->edges_capacity = 1024;
+  builder->runs_capacity = builder->runs_labels_capacity = 1024;
+  dawg->edges_start =
+      (uint32_t *)malloc(builder->states_capacity * sizeof(uint32_t));
+  dawg->targets =
+      (uint32_t *)malloc(builder->edges_capacity * sizeof(uint32_t));
+  dawg->labels = (char *)malloc(builder->edges_capacity);
+  dawg->runs_start =
+      (uint32_t *)malloc((builder->runs_capacity + 1) * sizeof(uint32_t));
+  dawg->runs_start[0] = 0;
+  dawg->runs_target =
+      (uint32_t *)malloc(builder->runs_capacity * sizeof(uint32_t));
+  dawg->runs_labels = (char *)malloc(builder->runs_labels_capacity);
+  dawg->unique = NULL;
+  dawg->filter = NULL;
+  builder->dawg = dawg;
+
+  builder->registry_capacity = 1024;
+  builder->registry =
+      (uint32_t *)calloc(builder->registry_capacity, sizeof(uint32_t));
+  builder->last = (char *)malloc(k + 1);
+  builder->last[0] = '\0';
+  builder->single.edges_size = 1;
+  builder->single.runs_start[0] = builder->single.runs_start[1] = 0;
+  builder->single.runs_capacity = 0;
+  builder->single.runs_labels = builder->last;
+  for (size_t i = 0; i <= k; i++) {
+    builder->path[i].runs_capacity = k + 1;
+    builder->path[i].runs_labels = (char *)malloc(k + 1);
+  }
+  builder->path[0].edges_size = 0;
+  builder->path[0].runs_start[0] = 0;
+  return builder;
+}
+
+void dawg_builder_add(dawg_builder_t *builder, char const *str) {
+  size_t k = builder->dawg->k, prefix = 0;
+
+  if (builder->dawg->strings > 0) {
+    while (prefix < k && str[prefix] == builder->last[prefix])
+      prefix++;
+    if (prefix == k)
+      return;
+    dawg_builder_minimize(builder, prefix);
+    // so is the last edge of the state where the strings diverge
+    dawg_builder_close(builder, prefix);
+  }
+
+  for (size_t i = prefix; i < k; i++) {
+    dawg_temp_t *temp = &builder->path[i];
+    temp->labels[temp->edges_size] = str[i];
+    temp->targets[temp->edges_size] = UINT32_MAX;
+    temp->runs_start[temp->edges_size + 1] = temp->runs_start[temp->edges_size];
+    temp->edges_size++;
+    builder->path[i + 1].edges_size = 0;
+    builder->path[i + 1].runs_start[0] = 0;
+  }
+
+  memcpy(builder->last, str, k + 1);
+  builder->dawg->strings++;
+}
+
+dawg_t *dawg_builder_finish(dawg_builder_t *builder) {
+  dawg_t *dawg = builder->dawg;
+
+  if (dawg->strings > 0) {
+    dawg_builder_minimize(builder, 0);
+    dawg_builder_close(builder, 0);
+  }
+  dawg->root = dawg_builder_register(builder, &builder->path[0]);
+
+  dawg->edges_start = (uint32_t *)realloc(
+      dawg->edges_start, (dawg->states_size + 1) * sizeof(uint32_t));
+  dawg->edges_start[dawg->states_size] = (uint32_t)dawg->edges_size;
+  dawg->targets = (uint32_t *)realloc(
+      dawg->targets, (dawg->edges_size + 1) * sizeof(uint32_t));
+  dawg->labels = (char *)realloc(dawg->labels, dawg->edges_size + 1);
+  dawg->runs_start = (uint32_t *)realloc(
+      dawg->runs_start, (dawg->runs_size + 1) * sizeof(uint32_t));
+  dawg->runs_target = (uint32_t *)realloc(
+      dawg->runs_target, (dawg->runs_size + 1) * sizeof(uint32_t));
+  dawg->runs_labels = (char *)realloc(
+      dawg->runs_labels, dawg->runs_start[dawg->runs_size] + 1);
+  dawg->filter = (rax_epoch_t *)calloc(dawg->states_size, sizeof(rax_epoch_t));
+
+  // the sources of the edges to a state are built after it, so a pass from
+  // the root (the last state) down reaches every state after all its sources
+  uint32_t *sources = (uint32_t *)calloc(dawg->states_size, sizeof(uint32_t));
+  char const *run;
+  size_t run_size;
+  for (uint32_t e = 0; e < dawg->edges_size; e++)
+    sources[dawg_target(dawg, e, &run, &run_size)]++;
+  dawg->unique = (bool *)calloc(dawg->states_size, sizeof(bool));
+  dawg->unique[dawg->root] = true;
+  for (uint32_t s = dawg->root + 1; s-- > 0;) {
+    for (uint32_t e = dawg->edges_start[s]; e < dawg->edges_start[s + 1]; e++) {
+      uint32_t target = dawg_target(dawg, e, &run, &run_size);
+      dawg->unique[target] = dawg->unique[s] && sources[target] == 1;
+    }
+  }
+  free(sources);
+
+  for (size_t i = 0; i <= dawg->k; i++)
+    free(builder->path[i].runs_labels);
+  free(builder->registry);
+  free(builder->last);
+  free(builder);
+  return dawg;
+}
+
+void dawg_builder_minimize(dawg_builder_t *builder, size_t depth) {
+  for (size_t i = builder->dawg->k; i > depth; i--) {
+    dawg_temp_t *parent = &builder->path[i - 1], *temp = &builder->path[i];
+
+    if (temp->edges_size == 1) {
+      // the edge to the state leads on to its target, through the label of
+      // its edge and the chain after it, which follow in the last string
+      parent->runs_start[parent->edges_size] += 1 + temp->runs_start[1];
+      parent->targets[parent->edges_size - 1] = temp->targets[0];
+    } else {
+      if (temp->edges_size > 0)
+        dawg_builder_close(builder, i);
+      parent->targets[parent->edges_size - 1] =
+          dawg_builder_register(builder, temp);
+    }
+  }
+}
+
+void dawg_builder_close(dawg_builder_t *builder, size_t depth) {
+  dawg_temp_t *temp = &builder->path[depth];
+  uint32_t *start = &temp->runs_start[temp->edges_size - 1];
+  char const *chain = builder->last + depth + 1;
+  size_t size = start[1] - start[0];
+
+  if (size >= DAWG_MIN_RUN) {
+    if (start[1] > temp->runs_capacity) {
+      temp->runs_capacity = 2 * start[1];
+      temp->runs_labels =
+          (char *)realloc(temp->runs_labels, temp->runs_capacity);
+    }
+    memcpy(temp->runs_labels + start[0], chain, size);
+    return;
+  }
+
+  // register the states of the chain, from the last one
+  dawg_temp_t *single = &builder->single;
+  uint32_t *target = &temp->targets[temp->edges_size - 1];
+  while (size-- > 0) {
+    single->labels[0] = chain[size];
+    single->targets[0] = *target;
+    *target = dawg_builder_register(builder, single);
+  }
+  start[1] = start[0];
+}
+
+uint32_t dawg_builder_register(dawg_builder_t *builder,
+                               dawg_temp_t const *temp) {
+  dawg_t *dawg = builder->dawg;
+  size_t mask = builder->registry_capacity - 1;
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (size_t i = 0; i < temp->edges_size; i++)
+    hash = dawg_hash(hash, temp->labels[i],
+                     temp->runs_labels + temp->runs_start[i],
+                     temp->runs_start[i + 1] - temp->runs_start[i],
+                     temp->targets[i]);
+  size_t slot = (hash ^ (hash >> 32)) & mask;
+
+  for (; builder->registry[slot] != 0; slot = (slot + 1) & mask) {
+    uint32_t state = builder->registry[slot] - 1;
+    uint32_t start = dawg->edges_start[state];
+    size_t edges_size = (state + 1 == dawg->states_size
+                             ? dawg->edges_size
+                             : dawg->edges_start[state + 1]) -
+                        start;
+
+    if (edges_size != temp->edges_size ||
+        memcmp(dawg->labels + start, temp->labels, edges_size) != 0)
+      continue;
+
+    size_t i = 0;
+    for (; i < edges_size; i++) {
+      char const *run;
+      size_t run_size;
+      uint32_t target = dawg_target(dawg, start + i, &run, &run_size);
+      if (target != temp->targets[i] ||
+          run_size != temp->runs_start[i + 1] - temp->runs_start[i] ||
+          memcmp(run, temp->runs_labels + temp->runs_start[i], run_size) != 0)
+        break;
+    }
+    if (i == edges_size)
+      return state;
+  }
+
+  if (dawg->states_size == builder->states_capacity) {
+    builder->states_capacity *= 2;
+    dawg->edges_start = (uint32_t *)realloc(
+        dawg->edges_start, builder->states_capacity * sizeof(uint32_t));
+  }
+  while (dawg->edges_size + temp->edges_size > builder->edges_capacity) {
+    builder->edges_capacity *= 2;
+    dawg->targets = (uint32_t *)realloc(
+        dawg->targets, builder->edges_capacity * sizeof(uint32_t));
+    dawg->labels = (char *)realloc(dawg->labels, builder->edges_capacity);
+  }
+
+  uint32_t state = (uint32_t)dawg->states_size++;
+  dawg->edges_start[state] = (uint32_t)dawg->edges_size;
+  memcpy(dawg->labels + dawg->edges_size, temp->labels, temp->edges_size);
+  memcpy(dawg->targets + dawg->edges_size, temp->targets,
+         temp->edges_size * sizeof(uint32_t));
+
+  // the edges skipping chains go on with runs
+  for (size_t i = 0; i < temp->edges_size; i++) {
+    size_t size = temp->runs_start[i + 1] - temp->runs_start[i];
+    if (size == 0)
+      continue;
+
+    if (dawg->runs_size == builder->runs_capacity) {
+      builder->runs_capacity *= 2;
+      dawg->runs_start = (uint32_t *)realloc(
+          dawg->runs_start, (builder->runs_capacity + 1) * sizeof(uint32_t));
+      dawg->runs_target = (uint32_t *)realloc(
+          dawg->runs_target, builder->runs_capacity * sizeof(uint32_t));
+    }
+    uint32_t end = dawg->runs_start[dawg->runs_size];
+    while (end + size > builder->runs_labels_capacity) {
+      builder->runs_labels_capacity *= 2;
+      dawg->runs_labels =
+          (char *)realloc(dawg->runs_labels, builder->runs_labels_capacity);
+    }
+    memcpy(dawg->runs_labels + end, temp->runs_labels + temp->runs_start[i],
+           size);
+    dawg->runs_target[dawg->runs_size] = temp->targets[i];
+    dawg->runs_start[dawg->runs_size + 1] = end + (uint32_t)size;
+    dawg->targets[dawg->edges_size + i] =
+        DAWG_RUN + (uint32_t)dawg->runs_size++;
+  }
+  dawg->edges_size += temp->edges_size;
+  builder->registry[slot] = state + 1;
+
+  // keep the table at most half full
+  if (2 * dawg->states_size > builder->registry_capacity) {
+    size_t capacity = 2 * builder->registry_capacity;
+    uint32_t *table = (uint32_t *)calloc(capacity, sizeof(uint32_t));
+
+    for (uint32_t s = 0; s < dawg->states_size; s++) {
+      uint32_t end = s + 1 == dawg->states_size ? (uint32_t)dawg->edges_size
+                                                : dawg->edges_start[s + 1];
+      hash = 14695981039346656037ULL;
+      for (uint32_t e = dawg->edges_start[s]; e < end; e++) {
+        char const *run;
+        size_t run_size;
+        uint32_t target = dawg_target(dawg, e, &run, &run_size);
+        hash = dawg_hash(hash, dawg->labels[e], run, run_size, target);
+      }
+      size_t i = (hash ^ (hash >> 32)) & (capacity - 1);
+      while (table[i] != 0)
+        i = (i + 1) & (capacity - 1);
+      table[i] = s + 1;
+    }
+
+    free(builder->registry);
+    builder->registry = table;
+    builder->registry_capacity = capacity;
+  }
+
+  return state;
+}
+
+uint64_t dawg_hash(uint64_t hash, char label, char const *run,
+                   size_t run_size, uint32_t target) {
+  // FNV-1a over the characters of the edge and its target
+  hash ^= (unsigned char)label;
+  hash *= 1099511628211ULL;
+  for (size_t i = 0; i < run_size; i++) {
+    hash ^= (unsigned char)run[i];
+    hash *= 1099511628211ULL;
+  }
+  hash ^= target;
+  hash *= 1099511628211ULL;
+  return hash;
+}
+
+bool dawg_accepts(dawg_t const *dawg, char const *str) {
+  uint32_t state = dawg->root;
+
+  if (dawg->strings == 0)
+    return false;
+
+  for (size_t i = 0; i < dawg->k;) {
+    uint32_t lo = dawg->edges_start[state], hi = dawg->edges_start[state + 1];
+
+    // edges are sorted by label
+    while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      if ((unsigned char)dawg->labels[mid] < (unsigned char)str[i])
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if (lo == dawg->edges_start[state + 1] || dawg->labels[lo] != str[i])
+      return false;
+
+    char const *run;
+    size_t run_size;
+    state = dawg_target(dawg, lo, &run, &run_size);
+    if (memcmp(run, str + i + 1, run_size) != 0)
+      return false;
+    i += 1 + run_size;
+  }
+
+  return true;
+}
+
+dawg_t *dawg_rebuild(dawg_t const *dawg) {
+  size_t k = dawg->k, i = 0;
+  dawg_builder_t *builder = dawg_builder_alloc(k);
+  uint32_t *stack = (uint32_t *)malloc(2 * (k + 1) * sizeof(uint32_t));
+  char *str = (char *)malloc(k + 1);
+  size_t depth = SIZE_MAX;
+  bool more = dawg_next(dawg, stack, stack + (k + 1), &depth, str);
+
+  // both sequences are sorted, and disjoint
+  while (more || i < dawg->pending_size) {
+    char const *pending = dawg->pending + i * (k + 1);
+
+    if (more && (i == dawg->pending_size || strcmp(str, pending) < 0)) {
+      dawg_builder_add(builder, str);
+      more = dawg_next(dawg, stack, stack + (k + 1), &depth, str);
+    } else {
+      dawg_builder_add(builder, pending);
+      i++;
+    }
+  }
+
+  free(str);
+  free(stack);
+  return dawg_builder_finish(builder);
+}
+
+int dawg_compare(void const *a, void const *b) {
+  return strcmp((char const *)a, (char const *)b);
+}
+
+bool dawg_next(dawg_t const *dawg, uint32_t *states, uint32_t *edges,
+               size_t *depth, char *str) {
+  size_t k = dawg->k;
+  size_t d = *depth, length = k, run_size;
+  char const *run;
+
+  if (dawg->strings == 0)
+    return false;
+
+  if (d == SIZE_MAX) {
+    // first string: descend along the first edges
+    d = length = 0;
+    states[0] = dawg->root;
+    edges[0] = dawg->edges_start[dawg->root];
+  } else {
+    // backtrack to the deepest state with an edge left
+    do {
+      if (d == 0)
+        return false;
+      d--;
+      dawg_target(dawg, edges[d], &run, &run_size);
+      length -= 1 + run_size;
+    } while (edges[d] + 1 == dawg->edges_start[states[d] + 1]);
+    edges[d]++;
+  }
+
+  for (;; d++) {
+    str[length] = dawg->labels[edges[d]];
+    states[d + 1] = dawg_target(dawg, edges[d], &run, &run_size);
+    memcpy(str + length + 1, run, run_size);
+    length += 1 + run_size;
+    if (length == k)
+      break;
+    edges[d + 1] = dawg->edges_start[states[d + 1]];
+  }
+
+  str[k] = '\0';
+  *depth = d + 1;
+  return true;
+}
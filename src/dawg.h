@@ -0,0 +1,160 @@
+#ifndef DAWG_H
+#define DAWG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "memory_allocator.h"
+#include "rax.h"
+
+/*
+ * Minimal acyclic automaton (DAWG) accepting the strings of the dictionary.
+ * Unlike the radix trie, which only shares prefixes, equivalent suffixes are
+ * stored once, which pays off on natural-language word lists (inflected
+ * forms). Adding a string may change any state, so inserted strings are kept
+ * apart in a sorted array, and only merged into the automaton, rebuilding it,
+ * once they exceed 1 / DAWG_PENDING_RATIO of its strings (see dawg_insert).
+ *
+ * Chains of states with a single edge are compressed, as in the radix trie:
+ * such a chain of at least DAWG_MIN_RUN states is replaced by a run, the
+ * characters of their edges and the state they lead to, and the edge to its
+ * first state goes on with the run. Otherwise, the strings of a dictionary
+ * sharing few suffixes (long random strings) would take a state per
+ * character. Shorter chains are kept as states, which many strings may share
+ * (the endings of inflected forms), while each edge would have its own run.
+ *
+ * States are numbered in the order they were built, so the targets of the
+ * edges of a state precede it, and the final state (the only one without
+ * edges) is state 0. Since all the strings have length k, all the paths from
+ * a state to the final one have the same length, so a state is always reached
+ * at the same depth: position constraints can be checked on the states
+ * themselves, while occurrence constraints depend on the path taken, and are
+ * checked while traversing (see update_filter_dawg).
+ *
+ * Members:
+ * - size_t k:             Length of the strings
+ * - size_t strings:       Number of strings accepted by the automaton
+ * - size_t pending_size:  Number of strings inserted since it was built
+ * - char *pending:        Those strings, sorted (k + 1 bytes each)
+ * - rax_epoch_t *pending_filter: Game in which each of them is pruned
+ * - size_t states_size:   Number of states
+ * - size_t edges_size:    Number of edges
+ * - uint32_t root:        Initial state
+ * - uint32_t *edges_start: Edges of state s are [edges_start[s],
+ *     edges_start[s + 1]), sorted by label
+ * - uint32_t *targets:    Target state of each edge, or DAWG_RUN + r if its
+ *     label goes on with run r (see dawg_target)
+ * - char *labels:         Label of each edge
+ * - size_t runs_size:     Number of runs
+ * - uint32_t *runs_start: Characters of run r are [runs_start[r],
+ *     runs_start[r + 1]) in `runs_labels`
+ * - uint32_t *runs_target: State reached at the end of each run
+ * - char *runs_labels:    Characters of the runs
+ * - bool *unique:         Whether a single path leads to each state from the
+ *     root (in the prefix tree part of the automaton)
+ * - rax_epoch_t *filter:  Game in which no string through each state is
+ *     compatible with the constraints (as the filter of rax_t, see
+ *     update_filter_dawg)
+ */
+#define DAWG_PENDING_RATIO 8
+// a run takes 8 bytes and its characters, a state with a single edge 12
+// bytes, shared by all the edges to it
+#define DAWG_MIN_RUN 4
+#define DAWG_RUN ((uint32_t)1 << 31)
+
+typedef struct dawg_t {
+  size_t k;
+  size_t strings;
+  size_t pending_size;
+  char *pending;
+  rax_epoch_t *pending_filter;
+  size_t states_size;
+  size_t edges_size;
+  uint32_t root;
+  uint32_t *edges_start;
+  uint32_t *targets;
+  char *labels;
+  size_t runs_size;
+  uint32_t *runs_start;
+  uint32_t *runs_target;
+  char *runs_labels;
+  bool *unique;
+  rax_epoch_t *filter;
+} dawg_t;
+
+/*
+ * Follows an edge.
+ * Parameters:
+ * - dawg_t const *dawg: Pointer to the automaton
+ * - uint32_t e: Edge
+ * - char const **run, size_t *run_size: Receive the characters of the label
+ *     of the edge past its first one (none if not a run)
+ * Returns: The state the edge leads to
+ */
+static inline uint32_t dawg_target(dawg_t const *dawg, uint32_t e,
+                                   char const **run, size_t *run_size) {
+  uint32_t target = dawg->targets[e];
+
+  if (target < DAWG_RUN) {
+    *run = dawg->runs_labels;
+    *run_size = 0;
+    return target;
+  }
+  target -= DAWG_RUN;
+  *run = dawg->runs_labels + dawg->runs_start[target];
+  *run_size = dawg->runs_start[target + 1] - dawg->runs_start[target];
+  return dawg->runs_target[target];
+}
+
+/*
+ * Builds the automaton of the strings in a radix trie.
+ * Parameters:
+ * - memory_allocator_t const *allocator: Allocator holding the trie
+ * - rax_t const *root: Root node of the trie
+ * - size_t k: Length of the strings
+ * Returns: Pointer to the new automaton
+ */
+dawg_t *dawg_from_rax(memory_allocator_t const *allocator, rax_t const *root,
+                      size_t k);
+
+/*
+ * Inserts strings, adding them to the pending ones, and rebuilds the automaton
+ * with all of them if they are too many: the automaton grows geometrically,
+ * so a sequence of small insertions only costs a logarithmic number of
+ * rebuilds.
+ * Parameters:
+ * - dawg_t *dawg: Pointer to the automaton
+ * - char *strs: New strings, each followed by '\0' (k + 1 bytes each), sorted
+ *     in place
+ * - size_t count: Number of new strings
+ * Returns: true if the automaton was rebuilt, clearing its filters
+ */
+bool dawg_insert(dawg_t *dawg, char *strs, size_t count);
+
+/*
+ * Checks whether a string is in the dictionary (accepted or pending).
+ * Parameters:
+ * - dawg_t const *dawg: Pointer to the automaton
+ * - char const *str: String of length k
+ * Returns: true if str is in the dictionary
+ */
+bool dawg_search(dawg_t const *dawg, char const *str);
+
+/*
+ * Returns the game index to use for the game after `game` (see
+ * rax_next_epoch).
+ */
+size_t dawg_next_epoch(dawg_t *dawg, size_t game);
+
+/*
+ * Returns: Number of bytes taken by an automaton (with its pending strings)
+ */
+size_t dawg_bytes(dawg_t const *dawg);
+
+/*
+ * Deallocates an automaton.
+ */
+void dawg_dealloc(dawg_t *dawg);
+
+#endif // DAWG_H
@@ -0,0 +1,108 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ebr.h"
+#include "memory_allocator.h"
+
+static void ebr_release_limbo(ebr_t *ebr, size_t list);
+
+ebr_t *ebr_alloc(memory_allocator_t *allocator) {
+  ebr_t *ebr = (ebr_t *)malloc(sizeof(ebr_t));
+
+  ebr->allocator = allocator;
+  atomic_init(&ebr->epoch, 0);
+  atomic_init(&ebr->readers_count, 0);
+  for (size_t i = 0; i < EBR_MAX_READERS; i++) {
+    atomic_init(&ebr->slots[i].state, 0);
+  }
+  for (size_t i = 0; i < 3; i++) {
+    ebr->limbo[i] = NULL;
+    ebr->limbo_size[i] = 0;
+    ebr->limbo_capacity[i] = 0;
+  }
+  ebr->pending = 0;
+
+  allocator->ebr = ebr;
+  return ebr;
+}
+
+void ebr_dealloc(ebr_t *ebr) {
+  for (size_t i = 0; i < 3; i++) {
+    ebr_release_limbo(ebr, i);
+    free(ebr->limbo[i]);
+  }
+
+  ebr->allocator->ebr = NULL;
+  free(ebr);
+}
+
+size_t ebr_register(ebr_t *ebr) {
+  size_t reader = atomic_fetch_add(&ebr->readers_count, 1);
+
+  if (reader >= EBR_MAX_READERS) {
+    fprintf(stderr, "error: too many readers\n");
+    exit(EXIT_FAILURE);
+  }
+
+  return reader;
+}
+
+void ebr_enter(ebr_t *ebr, size_t reader) {
+  size_t epoch = atomic_load(&ebr->epoch);
+
+  // sequentially consistent, so that the announcement is visible to the
+  // writer before any handle of the trie is read
+  atomic_store(&ebr->slots[reader].state, epoch << 1 | 1);
+}
+
+void ebr_exit(ebr_t *ebr, size_t reader) {
+  atomic_store_explicit(&ebr->slots[reader].state, 0, memory_order_release);
+}
+
+void ebr_retire(ebr_t *ebr, memory_ref_t ref, size_t size) {
+  size_t list = atomic_load_explicit(&ebr->epoch, memory_order_relaxed) % 3;
+
+  if (ebr->limbo_size[list] == ebr->limbo_capacity[list]) {
+    ebr->limbo_capacity[list] =
+        ebr->limbo_capacity[list] == 0 ? 64 : 2 * ebr->limbo_capacity[list];
+    ebr->limbo[list] = (ebr_retired_t *)realloc(
+        ebr->limbo[list], ebr->limbo_capacity[list] * sizeof(ebr_retired_t));
+  }
+
+  ebr->limbo[list][ebr->limbo_size[list]++] = (ebr_retired_t){ref, size};
+
+  if (++ebr->pending >= EBR_COLLECT_THRESHOLD) {
+    ebr->pending = 0;
+    ebr_collect(ebr);
+  }
+}
+
+bool ebr_collect(ebr_t *ebr) {
+  size_t epoch = atomic_load(&ebr->epoch);
+  size_t readers_count = atomic_load(&ebr->readers_count);
+
+  for (size_t i = 0; i < readers_count && i < EBR_MAX_READERS; i++) {
+    size_t state = atomic_load(&ebr->slots[i].state);
+
+    // an active reader has not seen the current epoch yet
+    if ((state & 1) && state >> 1 != epoch)
+      return false;
+  }
+
+  // all the active readers entered during `epoch`, so none of them can access
+  // memory retired during epoch - 2 (which shares the limbo list with
+  // epoch + 1)
+  ebr_release_limbo(ebr, (epoch + 1) % 3);
+  atomic_store(&ebr->epoch, epoch + 1);
+  return true;
+}
+
+void ebr_release_limbo(ebr_t *ebr, size_t list) {
+  for (size_t i = 0; i < ebr->limbo_size[list]; i++) {
+    release(ebr->allocator, ebr->limbo[list][i].ref, ebr->limbo[list][i].size);
+  }
+
+  ebr->limbo_size[list] = 0;
+}
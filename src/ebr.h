@@ -0,0 +1,121 @@
+#ifndef EBR_H
+#define EBR_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "memory_allocator.h"
+
+/*
+ * Epoch-based reclamation, letting threads read a radix trie (rax_search,
+ * rax_print, rax_size) while a single writer inserts into it.
+ *
+ * The writer never modifies a label or a bucket in place: it builds the new
+ * nodes off to the side and publishes them by swinging a single handle, then
+ * retires the nodes it replaced (see retire in memory_allocator.h). Readers
+ * announce the global epoch they entered in; the writer only advances the
+ * epoch when every active reader has seen the current one, and a retired node
+ * is released two epochs after it was retired, when no reader can still hold
+ * it.
+ */
+#define EBR_MAX_READERS 64
+#define EBR_COLLECT_THRESHOLD 64
+
+typedef struct ebr_retired_t {
+  memory_ref_t ref;
+  size_t size;
+} ebr_retired_t;
+
+/*
+ * Reader announcement, alone in its cache line.
+ * Members:
+ * - state: 0 if the reader is not reading, (epoch << 1) | 1 otherwise
+ */
+typedef struct ebr_slot_t {
+  _Atomic size_t state;
+  char padding[64 - sizeof(size_t)];
+} ebr_slot_t;
+
+/*
+ * Reclamation domain.
+ * Members:
+ * - memory_allocator_t *allocator: Allocator the retired memory goes back to
+ * - epoch:          Global epoch
+ * - readers_count:  Number of registered readers
+ * - slots[]:        Announcements of the registered readers
+ * - limbo[e % 3]:   Memory retired during epoch e (size and capacity in
+ *     limbo_size and limbo_capacity)
+ * - size_t pending: Memory retired since the last attempt to collect
+ */
+typedef struct ebr_t {
+  memory_allocator_t *allocator;
+  _Atomic size_t epoch;
+  _Atomic size_t readers_count;
+  ebr_slot_t slots[EBR_MAX_READERS];
+  ebr_retired_t *limbo[3];
+  size_t limbo_size[3];
+  size_t limbo_capacity[3];
+  size_t pending;
+} ebr_t;
+
+/*
+ * Allocates a reclamation domain and attaches it to an allocator, so that
+ * retired memory is released only once no reader can access it.
+ * Parameters:
+ * - memory_allocator_t *allocator: Allocator to attach the domain to
+ * Returns: Pointer to the new domain
+ */
+ebr_t *ebr_alloc(memory_allocator_t *allocator);
+
+/*
+ * Detaches a domain from its allocator, releases the memory still retired and
+ * deallocates the domain. No reader may be active.
+ * Parameters:
+ * - ebr_t *ebr: Pointer to the domain
+ */
+void ebr_dealloc(ebr_t *ebr);
+
+/*
+ * Registers a reader (thread safe).
+ * Parameters:
+ * - ebr_t *ebr: Pointer to the domain
+ * Returns: Index of the reader, in [0, EBR_MAX_READERS)
+ */
+size_t ebr_register(ebr_t *ebr);
+
+/*
+ * Marks the beginning of a read of the trie by a registered reader. It never
+ * blocks. Handles and pointers obtained in between ebr_enter and ebr_exit must
+ * not be used after ebr_exit.
+ * Parameters:
+ * - ebr_t *ebr: Pointer to the domain
+ * - size_t reader: Index returned by ebr_register
+ */
+void ebr_enter(ebr_t *ebr, size_t reader);
+
+/*
+ * Marks the end of a read started with ebr_enter.
+ * Parameters: as for ebr_enter
+ */
+void ebr_exit(ebr_t *ebr, size_t reader);
+
+/*
+ * Retires memory made unreachable by the writer (called by retire).
+ * Parameters:
+ * - ebr_t *ebr: Pointer to the domain
+ * - memory_ref_t ref, size_t size: As for release
+ */
+void ebr_retire(ebr_t *ebr, memory_ref_t ref, size_t size);
+
+/*
+ * Tries to advance the epoch, releasing the memory retired two epochs before.
+ * Only the writer may call it.
+ * Parameters:
+ * - ebr_t *ebr: Pointer to the domain
+ * Returns: true if the epoch was advanced, false if a reader is still active
+ *   in an older epoch
+ */
+bool ebr_collect(ebr_t *ebr);
+
+#endif // EBR_H
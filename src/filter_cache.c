@@ -0,0 +1,136 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter_cache.h"
+
+/*
+ * Removes an entry, moving the last one to its place.
+ */
+static void filter_cache_remove(filter_cache_t *cache, size_t i);
+
+filter_cache_t *filter_cache_alloc(size_t capacity, size_t max_bytes) {
+  filter_cache_t *cache = (filter_cache_t *)malloc(
+      sizeof(filter_cache_t) + capacity * sizeof(filter_cache_entry_t));
+
+  cache->capacity = capacity;
+  cache->max_bytes = max_bytes;
+  cache->size = cache->bytes = 0;
+  cache->clock = 0;
+  cache->lookups = cache->hits = cache->stores = 0;
+  cache->evictions = cache->invalidations = 0;
+  memset(cache->seen, 0, sizeof(cache->seen));
+  return cache;
+}
+
+uint64_t filter_cache_hash(unsigned char const *key, size_t key_size) {
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (size_t i = 0; i < key_size; i++) {
+    hash ^= key[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+filter_cache_entry_t const *filter_cache_find(filter_cache_t *cache,
+                                              unsigned char const *key,
+                                              size_t key_size, uint64_t hash) {
+  cache->lookups++;
+  cache->clock++;
+
+  // entries are few, and comparing hashes is cheaper than a hash table
+  for (size_t i = 0; i < cache->size; i++) {
+    filter_cache_entry_t *entry = &cache->entries[i];
+    if (entry->hash == hash && entry->key_size == key_size &&
+        memcmp(entry->key, key, key_size) == 0) {
+      entry->last_used = cache->clock;
+      cache->hits++;
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+bool filter_cache_admit(filter_cache_t *cache, uint64_t hash) {
+  uint64_t *seen = &cache->seen[hash % FILTER_CACHE_SEEN];
+
+  // a hash of 0 stands for an empty slot, so it is never admitted: it just
+  // loses the cache
+  if (*seen == hash)
+    return true;
+
+  *seen = hash;
+  return false;
+}
+
+void filter_cache_store(filter_cache_t *cache, unsigned char const *key,
+                        size_t key_size, uint64_t hash, size_t count,
+                        rax_pruned_t *pruned) {
+  size_t bytes = key_size + rax_pruned_bytes(pruned);
+
+  if (cache->capacity == 0 || bytes > cache->max_bytes) {
+    free(pruned);
+    return;
+  }
+
+  while (cache->size == cache->capacity ||
+         cache->bytes + bytes > cache->max_bytes) {
+    size_t lru = 0;
+    for (size_t i = 1; i < cache->size; i++) {
+      if (cache->entries[i].last_used < cache->entries[lru].last_used)
+        lru = i;
+    }
+    filter_cache_remove(cache, lru);
+    cache->evictions++;
+  }
+
+  filter_cache_entry_t *entry = &cache->entries[cache->size++];
+  entry->hash = hash;
+  entry->key_size = key_size;
+  entry->key = (unsigned char *)malloc(key_size);
+  memcpy(entry->key, key, key_size);
+  entry->count = count;
+  entry->pruned = pruned;
+  entry->last_used = ++cache->clock;
+
+  cache->bytes += bytes;
+  cache->stores++;
+}
+
+void filter_cache_clear(filter_cache_t *cache) {
+  while (cache->size > 0)
+    filter_cache_remove(cache, cache->size - 1);
+
+  memset(cache->seen, 0, sizeof(cache->seen));
+  cache->invalidations++;
+}
+
+void filter_cache_print_stats(FILE *out, filter_cache_t const *cache) {
+  fprintf(out,
+          "filter cache: %zu lookups, %zu hits (%.1f%%), %zu stores, %zu "
+          "evictions, %zu invalidations, %zu entries, %zu bytes\n",
+          cache->lookups, cache->hits,
+          cache->lookups == 0 ? 0.0 : 100.0 * cache->hits / cache->lookups,
+          cache->stores, cache->evictions, cache->invalidations, cache->size,
+          cache->bytes);
+}
+
+void filter_cache_dealloc(filter_cache_t *cache) {
+  while (cache->size > 0)
+    filter_cache_remove(cache, cache->size - 1);
+  free(cache);
+}
+
+void filter_cache_remove(filter_cache_t *cache, size_t i) {
+  filter_cache_entry_t *entry = &cache->entries[i];
+
+  cache->bytes -= entry->key_size + rax_pruned_bytes(entry->pruned);
+  free(entry->key);
+  free(entry->pruned);
+  *entry = cache->entries[--cache->size];
+}
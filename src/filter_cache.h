@@ -0,0 +1,144 @@
+#ifndef FILTER_CACHE_H
+#define FILTER_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "rax.h"
+
+/*
+ * Cache of the strings pruned by update_filter, shared by all the games and
+ * keyed by the constraints (see help_key): a game reaching constraints met
+ * before restores the pruned strings (rax_pruned_apply) instead of filtering
+ * the whole trie. Entries record handles, so the cache must be cleared
+ * whenever the trie changes (insertions, compaction).
+ *
+ * The cache holds at most `capacity` entries and `max_bytes` bytes, evicting
+ * the least recently used entries. Recording an entry takes a traversal of the
+ * trie, so constraints are only admitted on their second miss: their hashes
+ * are remembered in a small direct-mapped table (`seen`) on the first one.
+ */
+#define FILTER_CACHE_DEFAULT_BYTES ((size_t)64 << 20)
+#define FILTER_CACHE_SEEN 1024
+
+/*
+ * Cached filtering.
+ * Members:
+ * - uint64_t hash:        Hash of the key
+ * - size_t key_size:      Size of the key
+ * - unsigned char *key:   Constraints (see help_key)
+ * - size_t count:         Number of strings left by the constraints
+ * - rax_pruned_t *pruned: Strings pruned by the constraints
+ * - uint64_t last_used:   Time of the last lookup hitting the entry
+ */
+typedef struct filter_cache_entry_t {
+  uint64_t hash;
+  size_t key_size;
+  unsigned char *key;
+  size_t count;
+  rax_pruned_t *pruned;
+  uint64_t last_used;
+} filter_cache_entry_t;
+
+/*
+ * Cache.
+ * Members:
+ * - size_t capacity, max_bytes: Maximum number of entries and of bytes
+ * - size_t size, bytes:         Number of entries and bytes taken by them
+ * - uint64_t clock:             Number of lookups and stores so far
+ * - size_t lookups, hits, stores, evictions, invalidations: Statistics
+ * - uint64_t seen[]:            Hashes of the keys missed once
+ * - filter_cache_entry_t entries[]: The entries
+ */
+typedef struct filter_cache_t {
+  size_t capacity;
+  size_t max_bytes;
+  size_t size;
+  size_t bytes;
+  uint64_t clock;
+  size_t lookups;
+  size_t hits;
+  size_t stores;
+  size_t evictions;
+  size_t invalidations;
+  uint64_t seen[FILTER_CACHE_SEEN];
+  filter_cache_entry_t entries[];
+} filter_cache_t;
+
+/*
+ * Allocates an empty cache.
+ * Parameters:
+ * - size_t capacity: Maximum number of entries
+ * - size_t max_bytes: Maximum number of bytes taken by the entries
+ * Returns: Pointer to the new cache
+ */
+filter_cache_t *filter_cache_alloc(size_t capacity, size_t max_bytes);
+
+/*
+ * Returns: Hash of a key
+ */
+uint64_t filter_cache_hash(unsigned char const *key, size_t key_size);
+
+/*
+ * Looks the constraints up.
+ * Parameters:
+ * - filter_cache_t *cache: Pointer to the cache
+ * - unsigned char const *key, size_t key_size: Constraints (see help_key)
+ * - uint64_t hash: Hash of the key
+ * Returns: The entry of the constraints, NULL on a miss
+ */
+filter_cache_entry_t const *filter_cache_find(filter_cache_t *cache,
+                                              unsigned char const *key,
+                                              size_t key_size, uint64_t hash);
+
+/*
+ * Tells whether constraints just missed are worth recording, i.e. whether
+ * they were already missed since the last time the cache was cleared.
+ * Parameters:
+ * - filter_cache_t *cache: Pointer to the cache
+ * - uint64_t hash: Hash of the key
+ * Returns: true if the constraints should be stored
+ */
+bool filter_cache_admit(filter_cache_t *cache, uint64_t hash);
+
+/*
+ * Records the strings left by constraints, evicting the least recently used
+ * entries if needed (nothing is stored if the record alone exceeds
+ * max_bytes).
+ * Parameters:
+ * - filter_cache_t *cache: Pointer to the cache
+ * - unsigned char const *key, size_t key_size: Constraints (copied)
+ * - uint64_t hash: Hash of the key
+ * - size_t count: Number of strings left by the constraints
+ * - rax_pruned_t *pruned: Strings pruned by the constraints (owned by the
+ *     cache from now on)
+ */
+void filter_cache_store(filter_cache_t *cache, unsigned char const *key,
+                        size_t key_size, uint64_t hash, size_t count,
+                        rax_pruned_t *pruned);
+
+/*
+ * Removes every entry, e.g. because the trie changed.
+ * Parameters:
+ * - filter_cache_t *cache: Pointer to the cache
+ */
+void filter_cache_clear(filter_cache_t *cache);
+
+/*
+ * Prints the statistics of the cache (lookups, hit rate, entries).
+ * Parameters:
+ * - FILE *out: File to print to
+ * - filter_cache_t const *cache: Pointer to the cache
+ */
+void filter_cache_print_stats(FILE *out, filter_cache_t const *cache);
+
+/*
+ * Deallocates a cache and its entries.
+ * Parameters:
+ * - filter_cache_t *cache: Pointer to the cache
+ */
+void filter_cache_dealloc(filter_cache_t *cache);
+
+#endif // FILTER_CACHE_H
@@ -1,5 +1,7 @@
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "constants.h"
 #include "help_constraints.h"
@@ -13,194 +15,610 @@ typedef struct val_with_flag_t {
 /*
  * Structure to store constraints and filtering information for word matching.
  *
+ * Characters are not indexed with char_index but through symbol_index, which
+ * only covers the symbols seen so far in the dictionary (alphabet_size of
+ * them). Column alphabet_size is shared by all the symbols not seen yet: no
+ * guess can contain them, so they all carry the same constraints.
+ *
+ * can_appear stays a flexible array even for the k with fixed-size kernels:
+ * its stride (alphabet_size + 1) is only known once the dictionary is read,
+ * and rows sized for the whole ALPHABET_SIZE would spread the constraints of
+ * a small alphabet over many more cache lines. It is allocated with the
+ * structure, so the fixed-k kernels still reach it without indirection, and
+ * only the number of rows (K) is a constant for them.
+ *
+ * k:                 Length of the strings
+ * alphabet_size:     Number of symbols seen so far in the dictionary
+ * symbol_index[c]:   Column of character c in counters and can_appear
+ * required[i]:       Columns of the characters with a positive lower bound,
+ *                    required_size of them
  * counters[i].flag:  If true, counters[i].val is exact else it is a lower bound
  * counters[i].val:   Lower boud or exact number of occurrences of character i
- * in the goal string can_appear[i][j]:  If false, character j does not appear
- * at position i in the goal string
+ *                    in the goal string
+ * can_appear[i * (alphabet_size + 1) + j]: If false, character j does not
+ *                    appear at position i in the goal string
  */
 typedef struct help_t {
-  val_with_flag_t counters[ALPHABET_SIZE];
+  size_t k;
+  size_t alphabet_size;
+  unsigned char symbol_index[256];
+  size_t required_size;
+  unsigned char required[ALPHABET_SIZE];
+  val_with_flag_t counters[ALPHABET_SIZE + 1];
   bool can_appear[];
 } help_t;
 
-static void reset(char const *, size_t *, size_t);
-static size_t update_filter_aux(rax_t *root, size_t *str_occur, size_t curr_idx,
-                                help_t *info, size_t game);
+static void reset(help_t const *info, char const *, size_t *, size_t);
+static void refresh_required(help_t *info);
+static size_t update_filter_bucket(rax_t *bucket, size_t *str_occur,
+                                   size_t curr_idx, help_t const *info,
+                                   size_t game);
+
+/*
+ * Counts (and prints, if str is not NULL) the strings compatible with `info`
+ * through the paths from `state`, reached at depth `depth` with the
+ * occurrences `str_occur`, which leave `missing` occurrences to satisfy the
+ * lower bounds of the counters. While printing, the pending strings of the
+ * automaton are printed (and counted) in order too, from the one at index
+ * *pending.
+ */
+static size_t filter_dawg_aux(dawg_t *dawg, uint32_t state, size_t depth,
+                              size_t *str_occur, size_t missing,
+                              help_t const *info, size_t game, char *str,
+                              size_t *pending);
+
+/*
+ * Prints the pending strings of an automaton compatible with `info` (and not
+ * pruned in `game`), from the one at index *pending up to the last one
+ * smaller than `bound` (all of them if it is NULL), advancing *pending past
+ * them.
+ * Returns: Number of strings printed
+ */
+static size_t print_pending_dawg(dawg_t const *dawg, help_t const *info,
+                                 size_t game, size_t *pending,
+                                 char const *bound);
+
+/*
+ * Defines NAME, the recursive part of update_filter_##SUFFIX, whose loops
+ * over the characters of a string run exactly K times. If COUNT is true, it
+ * also counts the nodes and buckets it visits into *visited (counting
+ * kernels are only used when the count is asked for, so that the hot loop
+ * pays nothing otherwise).
+ */
+#define DEFINE_UPDATE_FILTER_AUX(NAME, K, COUNT)                               \
+  static size_t NAME(memory_allocator_t const *allocator, rax_t *root,         \
+                     size_t *str_occur, size_t curr_idx, help_t const *info,   \
+                     size_t game, size_t *visited) {                           \
+    /* node and subtree filtered out for this `game` by the previous */        \
+    /* sequence of guesses and corresponding feedbacks */                      \
+    if (root->filter == game)                                                  \
+      return 0;                                                                \
+    if (COUNT)                                                                 \
+      (*visited)++;                                                            \
+                                                                               \
+    size_t const stride = info->alphabet_size + 1;                             \
+    size_t substr_idx, ans = 0;                                                \
+    memory_ref_t tmp;                                                          \
+                                                                               \
+    for (substr_idx = 0; root->substr[substr_idx] != '\0'; substr_idx++) {     \
+      size_t c_index =                                                         \
+          info->symbol_index[(unsigned char)root->substr[substr_idx]];         \
+      str_occur[c_index]++;                                                    \
+                                                                               \
+      /* root->substr[substr_idx] cannot appear at position */                 \
+      /* curr_idx + substr_idx, or it appears too many times (only its own */  \
+      /* counter changed since the previous character was checked) */          \
+      if (!info->can_appear[(curr_idx + substr_idx) * stride + c_index] ||     \
+          (info->counters[c_index].flag &&                                     \
+           str_occur[c_index] > info->counters[c_index].val)) {                \
+        rax_set_filter(root, game);                                            \
+        reset(info, root->substr, str_occur, substr_idx);                      \
+        return 0;                                                              \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    if (curr_idx + substr_idx == (K)) {                                        \
+      /* exact counters cannot be exceeded here, so only the lower bounds */   \
+      /* of the required characters are left to check */                       \
+      for (size_t i = 0; i < info->required_size; i++) {                       \
+        size_t c_index = info->required[i];                                    \
+        if (str_occur[c_index] < info->counters[c_index].val) {                \
+          rax_set_filter(root, game); /* node and subtree pruned */            \
+          reset(info, root->substr, str_occur, substr_idx);                    \
+          return 0;                                                            \
+        }                                                                      \
+      }                                                                        \
+                                                                               \
+      rax_set_filter(root, 0);                                                 \
+      reset(info, root->substr, str_occur, substr_idx);                        \
+      return 1;                                                                \
+    }                                                                          \
+                                                                               \
+    /* recur on the children, or scan them if they are packed in a bucket */  \
+    tmp = root->child;                                                         \
+    if (rax_is_bucket(rax_node(allocator, tmp))) {                             \
+      if (COUNT)                                                               \
+        (*visited)++;                                                          \
+      ans = update_filter_bucket(rax_node(allocator, tmp), str_occur,          \
+                                 curr_idx + substr_idx, info, game);           \
+    } else {                                                                   \
+      while (tmp != MEMORY_NULL_REF) {                                         \
+        rax_t *node = rax_node(allocator, tmp);                                \
+        ans += NAME(allocator, node, str_occur, curr_idx + substr_idx, info,   \
+                    game, visited);                                            \
+        tmp = node->sibling;                                                   \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    /* if no compatible strings found in subtree rooted at `root`, prune the */ \
+    /* root as well */                                                         \
+    if (ans == 0)                                                              \
+      rax_set_filter(root, game);                                              \
+                                                                               \
+    reset(info, root->substr, str_occur, substr_idx);                          \
+    return ans;                                                                \
+  }
+
+/*
+ * Defines help_update_##SUFFIX, compatible_##SUFFIX and
+ * update_filter_##SUFFIX (the latter through update_filter_aux_##SUFFIX, or
+ * update_filter_count_aux_##SUFFIX when the visited nodes are asked for),
+ * whose loops over the characters of a string run exactly K times. K is either
+ * a literal (fixed-k kernels) or `info->k` (generic kernels).
+ */
+#define DEFINE_HELP_KERNELS(SUFFIX, K)                                         \
+  static void help_update_##SUFFIX(help_t *info, char const *guess,            \
+                                   char const *feedback) {                     \
+    size_t const stride = info->alphabet_size + 1;                             \
+                                                                               \
+    /* Occurrences per-char of the characters in guess not corresponding to */ \
+    /* a '/' */                                                                \
+    size_t total_notslash[ALPHABET_SIZE + 1] = {0};                            \
+                                                                               \
+    /* Running occurrences per-char of the characters in guess not */          \
+    /* corresponding to a '/' */                                               \
+    size_t running_notslash[ALPHABET_SIZE + 1] = {0};                          \
+                                                                               \
+    /* count total non-'/' occurrences per letter */                           \
+    UNROLL for (size_t i = 0; i < (K); i++) {                                  \
+      if (feedback[i] != NO_MATCH) {                                           \
+        total_notslash[info->symbol_index[(unsigned char)guess[i]]]++;         \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    /* main loop */                                                            \
+    UNROLL for (size_t i = 0; i < (K); i++) {                                  \
+      size_t c_index = info->symbol_index[(unsigned char)guess[i]];            \
+                                                                               \
+      if (feedback[i] == PERFECT_MATCH) {                                      \
+        running_notslash[c_index]++;                                           \
+                                                                               \
+        /* the only character that can appear at position i is guess[i] */     \
+        for (size_t j = 0; j < stride; j++) {                                  \
+          if (j != c_index) {                                                  \
+            info->can_appear[i * stride + j] = false;                          \
+          }                                                                    \
+        }                                                                      \
+                                                                               \
+        /* if the counter of guess[i] is not exact yet, update its lower */    \
+        /* bound */                                                            \
+        if (!info->counters[c_index].flag &&                                   \
+            running_notslash[c_index] > info->counters[c_index].val) {         \
+          info->counters[c_index].val = running_notslash[c_index];             \
+        }                                                                      \
+      } else if (feedback[i] == PARTIAL_MATCH) {                               \
+        running_notslash[c_index]++;                                           \
+                                                                               \
+        /* guess[i] cannot appear at position i */                             \
+        info->can_appear[i * stride + c_index] = false;                        \
+                                                                               \
+        /* if the counter of guess[i] is not exact yet, update its lower */    \
+        /* bound */                                                            \
+        if (!info->counters[c_index].flag &&                                   \
+            running_notslash[c_index] > info->counters[c_index].val) {         \
+          info->counters[c_index].val = running_notslash[c_index];             \
+        }                                                                      \
+      } else if (feedback[i] == NO_MATCH) {                                    \
+        /* guess[i] cannot appear at position i */                             \
+        info->can_appear[i * stride + c_index] = false;                        \
+                                                                               \
+        /* set the counter of guess[i] to be exact and equal to */             \
+        /* total_notslash[c_index], since having an instance of guess[i] */    \
+        /* matched to `NO_MATCH` in feedback means that */                     \
+        /* total_notslash[c_index] is the exact number of occurrences of */    \
+        /* guess[i] in the hidden string */                                    \
+        info->counters[c_index].flag = true;                                   \
+        info->counters[c_index].val = total_notslash[c_index];                 \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    refresh_required(info);                                                    \
+  }                                                                            \
+                                                                               \
+  static bool compatible_##SUFFIX(char const *str, help_t const *info) {       \
+    size_t const stride = info->alphabet_size + 1;                             \
+    size_t str_occur[ALPHABET_SIZE + 1] = {0};                                 \
+                                                                               \
+    UNROLL for (size_t i = 0; i < (K); i++) {                                  \
+      size_t c_index = info->symbol_index[(unsigned char)str[i]];              \
+      str_occur[c_index]++;                                                    \
+                                                                               \
+      /* guess[i] cannot appear at position i */                               \
+      if (!info->can_appear[i * stride + c_index])                             \
+        return false;                                                          \
+    }                                                                          \
+                                                                               \
+    for (size_t i = 0; i < info->alphabet_size; i++) {                         \
+      size_t val = info->counters[i].val;                                      \
+                                                                               \
+      /* wrong number of occurrences of character guess[i] in guess */         \
+      if (val > str_occur[i] || (info->counters[i].flag && val < str_occur[i])) \
+        return false;                                                          \
+    }                                                                          \
+                                                                               \
+    return true;                                                               \
+  }                                                                            \
+                                                                               \
+  DEFINE_UPDATE_FILTER_AUX(update_filter_aux_##SUFFIX, K, false)               \
+  DEFINE_UPDATE_FILTER_AUX(update_filter_count_aux_##SUFFIX, K, true)          \
+                                                                               \
+  static size_t update_filter_##SUFFIX(memory_allocator_t const *allocator,    \
+                                       rax_t *root, help_t *info,              \
+                                       size_t game, size_t *counts,            \
+                                       size_t *visited) {                      \
+    size_t (*aux)(memory_allocator_t const *, rax_t *, size_t *, size_t,       \
+                  help_t const *, size_t, size_t *) =                          \
+        visited != NULL ? update_filter_count_aux_##SUFFIX                     \
+                        : update_filter_aux_##SUFFIX;                          \
+    size_t str_occur[ALPHABET_SIZE + 1] = {0};                                 \
+    size_t nodes = 0, ans = 0;                                                 \
+    memory_ref_t tmp = root->child;                                            \
+                                                                               \
+    if (counts == NULL || root->filter == game || tmp == MEMORY_NULL_REF ||    \
+        rax_is_bucket(rax_node(allocator, tmp))) {                             \
+      ans = aux(allocator, root, str_occur, 0, info, game, &nodes);            \
+    } else {                                                                   \
+      /* same as update_filter_aux on the root (whose label is empty), */      \
+      /* keeping the counts of its children */                                 \
+      nodes++;                                                                 \
+      for (size_t i = 0; tmp != MEMORY_NULL_REF; i++) {                        \
+        rax_t *node = rax_node(allocator, tmp);                                \
+        size_t count = aux(allocator, node, str_occur, 0, info, game, &nodes); \
+        if (i < ALPHABET_SIZE)                                                 \
+          counts[i] = count;                                                   \
+        ans += count;                                                          \
+        tmp = node->sibling;                                                   \
+      }                                                                        \
+      if (ans == 0)                                                            \
+        rax_set_filter(root, game);                                            \
+    }                                                                          \
+                                                                               \
+    if (visited != NULL)                                                       \
+      *visited = nodes;                                                        \
+    return ans;                                                                \
+  }
+
+#define DEFINE_FIXED_HELP_KERNELS(K) DEFINE_HELP_KERNELS(K, K)
+
+DEFINE_HELP_KERNELS(generic, info->k)
+FOR_EACH_FIXED_K(DEFINE_FIXED_HELP_KERNELS)
 
 help_t *help_alloc(size_t k) {
-  help_t *new_info =
-      (help_t *)malloc(sizeof(help_t) + k * ALPHABET_SIZE * sizeof(bool));
+  help_t *new_info = (help_t *)malloc(sizeof(help_t) +
+                                      k * (ALPHABET_SIZE + 1) * sizeof(bool));
+  new_info->k = k;
+  new_info->alphabet_size = 0;
+  memset(new_info->symbol_index, 0, sizeof(new_info->symbol_index));
+  help_reset(new_info, k);
   return new_info;
 }
 
 void help_reset(help_t *info, size_t k) {
-  for (size_t i = 0; i < ALPHABET_SIZE; i++) {
+  for (size_t i = 0; i <= info->alphabet_size; i++) {
     info->counters[i].val = 0;
     info->counters[i].flag = false;
   }
 
-  for (size_t i = 0; i < k * ALPHABET_SIZE; i++) {
+  for (size_t i = 0; i < k * (info->alphabet_size + 1); i++) {
     info->can_appear[i] = true;
   }
-}
-
-void help_dealloc(help_t *info) { free(info); }
-
-void help_update(help_t *info, char const *guess, char const *feedback) {
-  // Occurrences per-char of the characters in guess not corresponding to a '/'
-  size_t total_notslash[ALPHABET_SIZE] = {0};
 
-  // Running occurrences per-char of the characters in guess not corresponding
-  // to a '/'
-  size_t running_notslash[ALPHABET_SIZE] = {0};
+  info->required_size = 0;
+}
 
-  // count total non-'/' occurrences per letter
-  for (size_t i = 0; feedback[i] != '\0'; i++) {
-    if (feedback[i] != '/') {
-      total_notslash[char_index(guess[i])]++;
+void help_add_symbols(help_t *info, char const *str) {
+  for (size_t i = 0; str[i] != '\0'; i++) {
+    unsigned char c = (unsigned char)str[i];
+    size_t old_stride = info->alphabet_size + 1;
+
+    if (info->symbol_index[c] != info->alphabet_size)
+      continue; // already part of the alphabet
+
+    // move every row of can_appear to its position for the wider stride
+    // (last row first, since rows only move forward); the column of the new
+    // symbol and the new column of the unseen symbols both start as a copy of
+    // the old column of the unseen symbols
+    for (size_t row = info->k; row-- > 0;) {
+      bool *new_row = info->can_appear + row * (old_stride + 1);
+      memmove(new_row, info->can_appear + row * old_stride,
+              old_stride * sizeof(bool));
+      new_row[old_stride] = new_row[old_stride - 1];
     }
-  }
 
-  // main loop
-  for (size_t i = 0; feedback[i] != '\0'; i++) {
-    size_t c_index = char_index(guess[i]);
-
-    if (feedback[i] == PERFECT_MATCH) {
-      running_notslash[c_index]++;
-
-      // the only character that can appear at position i is guess[i]
-      for (size_t j = 0; j < ALPHABET_SIZE; j++) {
-        if (j != c_index) {
-          info->can_appear[i * ALPHABET_SIZE + j] = false;
-        }
-      }
-
-      // if the counter of guess[i] is not exact yet, update its lower bound
-      if (!info->counters[c_index].flag &&
-          running_notslash[c_index] > info->counters[c_index].val) {
-        info->counters[c_index].val = running_notslash[c_index];
-      }
-    } else if (feedback[i] == PARTIAL_MATCH) {
-      running_notslash[c_index]++;
-
-      // guess[i] cannot appear at position i
-      info->can_appear[i * ALPHABET_SIZE + c_index] = false;
-
-      // if the counter of guess[i] is not exact yet, update its lower bound
-      if (!info->counters[c_index].flag &&
-          running_notslash[c_index] > info->counters[c_index].val) {
-        info->counters[c_index].val = running_notslash[c_index];
-      }
-    } else if (feedback[i] == NO_MATCH) {
-      // guess[i] cannot appear at position i
-      info->can_appear[i * ALPHABET_SIZE + c_index] = false;
-
-      // set the counter of guess[i] to be exact and equal to
-      // total_notslash[c_index], since having an instance of guess[i] matched
-      // to `NO_MATCH` in feedback means that total_notslash[c_index] is the
-      // exact number of occurrences of guess[i] in the hidden string
-      info->counters[c_index].flag = true;
-      info->counters[c_index].val = total_notslash[c_index];
+    // the unseen symbols never appeared in a guess, so their counter is
+    // still the initial one
+    info->counters[old_stride].val = 0;
+    info->counters[old_stride].flag = false;
+
+    // c takes the old column of the unseen symbols, which move one to the
+    // right
+    info->alphabet_size++;
+    for (size_t j = 0; j < 256; j++) {
+      if (info->symbol_index[j] == old_stride - 1 && j != c)
+        info->symbol_index[j] = (unsigned char)info->alphabet_size;
     }
   }
 }
 
-bool compatible(char const *str, help_t const *info) {
-  size_t str_occur[ALPHABET_SIZE] = {0};
+size_t help_key_size(size_t k) {
+  return (ALPHABET_SIZE + 1) * (sizeof(size_t) + 1 + k);
+}
 
-  for (size_t i = 0; str[i] != '\0'; i++) {
-    size_t c_index = char_index(str[i]);
-    str_occur[c_index]++;
+size_t help_key(help_t const *info, unsigned char *key) {
+  size_t const stride = info->alphabet_size + 1;
+  size_t size = 0;
 
-    // guess[i] cannot appear at position i
-    if (!info->can_appear[i * ALPHABET_SIZE + c_index])
-      return false;
+  // counters field by field (val_with_flag_t has padding), then can_appear;
+  // required is derived from the counters
+  for (size_t i = 0; i < stride; i++) {
+    memcpy(key + size, &info->counters[i].val, sizeof(size_t));
+    key[size + sizeof(size_t)] = info->counters[i].flag;
+    size += sizeof(size_t) + 1;
   }
+  for (size_t i = 0; i < info->k * stride; i++)
+    key[size++] = info->can_appear[i];
 
-  for (size_t i = 0; i < ALPHABET_SIZE; i++) {
-    size_t val = info->counters[i].val;
+  return size;
+}
 
-    // wrong number of occurrences of character guess[i] in guess
-    if (val > str_occur[i] || (info->counters[i].flag && val < str_occur[i]))
-      return false;
-  }
+void help_dealloc(help_t *info) { free(info); }
 
-  return true;
+void help_update(help_t *info, char const *guess, char const *feedback) {
+  help_kernels_select(info->k)->help_update(info, guess, feedback);
 }
 
-size_t update_filter(rax_t *root, help_t *info, size_t game) {
-  size_t str_occur[ALPHABET_SIZE] = {0};
-  return update_filter_aux(root, str_occur, 0, info, game);
+bool compatible(char const *str, help_t const *info) {
+  return help_kernels_select(info->k)->compatible(str, info);
 }
 
-size_t update_filter_aux(rax_t *root, size_t *str_occur, size_t curr_idx,
-                         help_t *info, size_t game) {
-  // node and subtree filtered out for this `game` by the previous
-  // sequence of guesses and corresponding feedbacks
-  if (root->filter == game)
-    return 0;
+size_t update_filter(memory_allocator_t const *allocator, rax_t *root,
+                     help_t *info, size_t game, size_t *counts,
+                     size_t *visited) {
+  return help_kernels_select(info->k)->update_filter(allocator, root, info,
+                                                     game, counts, visited);
+}
 
-  size_t substr_idx, ans = 0;
-  rax_t *tmp;
+size_t update_filter_dawg(dawg_t *dawg, help_t const *info, size_t game) {
+  size_t str_occur[ALPHABET_SIZE + 1] = {0};
+  size_t missing = 0, ans = 0;
+
+  for (size_t i = 0; i < info->required_size; i++)
+    missing += info->counters[info->required[i]].val;
+
+  if (dawg->strings > 0 && dawg->filter[dawg->root] != game)
+    ans = filter_dawg_aux(dawg, dawg->root, 0, str_occur, missing, info, game,
+                          NULL, NULL);
+
+  // pending strings are checked one by one, as the suffixes of a bucket
+  help_kernels_t const *kernels = help_kernels_select(info->k);
+  for (size_t i = 0; i < dawg->pending_size; i++) {
+    if (dawg->pending_filter[i] == game)
+      continue;
+    if (kernels->compatible(dawg->pending + i * (dawg->k + 1), info))
+      ans++;
+    else
+      dawg->pending_filter[i] = (rax_epoch_t)game;
+  }
+  return ans;
+}
 
-  for (substr_idx = 0; root->substr[substr_idx] != '\0'; substr_idx++) {
-    size_t c_index = char_index(root->substr[substr_idx]);
-    str_occur[c_index]++;
+size_t print_filtered_dawg(dawg_t *dawg, help_t const *info, size_t game) {
+  size_t str_occur[ALPHABET_SIZE + 1] = {0};
+  size_t missing = 0, pending = 0, ans = 0;
+  char *str = (char *)malloc(dawg->k + 1);
+
+  for (size_t i = 0; i < info->required_size; i++)
+    missing += info->counters[info->required[i]].val;
+
+  str[dawg->k] = '\0';
+  if (dawg->strings > 0 && dawg->filter[dawg->root] != game)
+    ans = filter_dawg_aux(dawg, dawg->root, 0, str_occur, missing, info, game,
+                          str, &pending);
+  ans += print_pending_dawg(dawg, info, game, &pending, NULL);
+  free(str);
+  return ans;
+}
 
-    // root->substr[substr_idx] cannot appear at position curr_idx + substr_idx
-    if (!info->can_appear[(curr_idx + substr_idx) * ALPHABET_SIZE + c_index]) {
-      root->filter = game;
-      reset(root->substr, str_occur, substr_idx);
-      return 0;
+help_kernels_t const *help_kernels_select(size_t k) {
+  static help_kernels_t const generic_kernels = {
+      gen_constraint, help_update_generic, compatible_generic,
+      update_filter_generic};
+
+  switch (k) {
+#define KERNELS_CASE(K)                                                        \
+  case K: {                                                                    \
+    static help_kernels_t const fixed_kernels = {                              \
+        gen_constraint_##K, help_update_##K, compatible_##K,                   \
+        update_filter_##K};                                                    \
+    return &fixed_kernels;                                                     \
+  }
+    FOR_EACH_FIXED_K(KERNELS_CASE)
+#undef KERNELS_CASE
+  default:
+    return &generic_kernels;
+  }
+}
+
+static size_t update_filter_bucket(rax_t *bucket, size_t *str_occur,
+                                   size_t curr_idx, help_t const *info,
+                                   size_t game) {
+  size_t const stride = info->alphabet_size + 1;
+  size_t const suffix_size = rax_bucket_suffix_size(bucket);
+  size_t ans = 0;
+
+  // suffixes already filtered out for this `game` are skipped
+  uint64_t pruned = bucket->filter == game ? rax_bucket_pruned(bucket) : 0;
+
+  for (size_t i = 0; i < rax_bucket_size(bucket); i++) {
+    if ((pruned >> i) & 1)
+      continue;
+
+    char const *suffix = rax_bucket_suffix(bucket, i);
+    bool compatible = true;
+    size_t checked;
+
+    // same checks as update_filter_aux on a leaf with label `suffix`
+    for (checked = 0; compatible && checked < suffix_size; checked++) {
+      size_t c_index = info->symbol_index[(unsigned char)suffix[checked]];
+      str_occur[c_index]++;
+
+      compatible =
+          info->can_appear[(curr_idx + checked) * stride + c_index] &&
+          !(info->counters[c_index].flag &&
+            str_occur[c_index] > info->counters[c_index].val);
     }
 
-    for (size_t i = 0; i < ALPHABET_SIZE; i++) {
-      // too many occurrences of the ith character
-      if (info->counters[i].flag && str_occur[i] > info->counters[i].val) {
-        root->filter = game;
-        reset(root->substr, str_occur, substr_idx);
-        return 0;
-      }
+    for (size_t j = 0; compatible && j < info->required_size; j++) {
+      size_t c_index = info->required[j];
+      compatible = str_occur[c_index] >= info->counters[c_index].val;
     }
+
+    for (size_t j = 0; j < checked; j++)
+      str_occur[info->symbol_index[(unsigned char)suffix[j]]]--;
+
+    if (compatible)
+      ans++;
+    else
+      pruned |= (uint64_t)1 << i;
   }
 
-  tmp = root->child;
-  if (tmp == NULL) {
-    for (size_t i = 0; i < ALPHABET_SIZE; i++) {
-      // checking if either lower boud or exact of occurrences of the ith
-      // character is not satisfied
-      if (str_occur[i] < info->counters[i].val ||
-          (info->counters[i].flag && str_occur[i] != info->counters[i].val)) {
-        root->filter = game; // node and subtree pruned
-        reset(root->substr, str_occur, substr_idx);
-        return 0;
-      }
+  rax_set_filter(bucket, game);
+  rax_bucket_set_pruned(bucket, pruned);
+  return ans;
+}
+
+static size_t filter_dawg_aux(dawg_t *dawg, uint32_t state, size_t depth,
+                              size_t *str_occur, size_t missing,
+                              help_t const *info, size_t game, char *str,
+                              size_t *pending) {
+  size_t const stride = info->alphabet_size + 1;
+  size_t ans = 0;
+  bool pruned = true;
+
+  if (depth == dawg->k) {
+    // exact counters cannot be exceeded here, so only the lower bounds are
+    // left to check
+    if (missing > 0)
+      return 0;
+    if (str == NULL)
+      return 1;
+    ans = print_pending_dawg(dawg, info, game, pending, str);
+    printf("%s\n", str);
+    return ans + 1;
+  }
+
+  for (uint32_t e = dawg->edges_start[state]; e < dawg->edges_start[state + 1];
+       e++) {
+    char const *run;
+    size_t run_size;
+    uint32_t target = dawg_target(dawg, e, &run, &run_size);
+    size_t size = 1 + run_size;
+
+    if (dawg->filter[target] == game)
+      continue;
+
+    // the label of the edge, then its run, from `depth` on
+    size_t i = 0;
+    while (i < size) {
+      char c = i == 0 ? dawg->labels[e] : run[i - 1];
+      if (!info->can_appear[(depth + i) * stride +
+                            info->symbol_index[(unsigned char)c]])
+        break;
+      i++;
+    }
+    if (i < size)
+      continue;
+
+    size_t left = missing;
+    for (i = 0; i < size; i++) {
+      char c = i == 0 ? dawg->labels[e] : run[i - 1];
+      size_t c_index = info->symbol_index[(unsigned char)c];
+      val_with_flag_t const *counter = &info->counters[c_index];
+
+      // each character left lowers `missing` by at most one
+      left -= str_occur[c_index] < counter->val;
+      if ((counter->flag && str_occur[c_index] >= counter->val) ||
+          left > dawg->k - depth - i - 1)
+        break;
+      if (str != NULL)
+        str[depth + i] = c;
+      str_occur[c_index]++;
     }
 
-    root->filter = 0;
-    reset(root->substr, str_occur, substr_idx);
-    return 1;
-  } else {
-    // recur on the children
-    while (tmp != NULL) {
-      ans +=
-          update_filter_aux(tmp, str_occur, curr_idx + substr_idx, info, game);
-      tmp = tmp->sibling;
+    if (i < size) {
+      // other paths to the state may get past the occurrence constraints
+      pruned = false;
+    } else {
+      ans += filter_dawg_aux(dawg, target, depth + size, str_occur, left, info,
+                             game, str, pending);
+      pruned = pruned && dawg->filter[target] == game;
     }
+    while (i-- > 0) {
+      char c = i == 0 ? dawg->labels[e] : run[i - 1];
+      str_occur[info->symbol_index[(unsigned char)c]]--;
+    }
+  }
+
+  // every edge is ruled out by the position constraints (or leads to a
+  // pruned state), so no path gets through the state; if a single path leads
+  // to it, the occurrences along it are always the same, so the state can be
+  // pruned as a node of the trie
+  if (pruned || (ans == 0 && dawg->unique[state]))
+    dawg->filter[state] = (rax_epoch_t)game;
+  return ans;
+}
 
-    // if no compatible strings found in subtree rooted at `root`, prune the
-    // root as well
-    if (ans == 0)
-      root->filter = game;
+static size_t print_pending_dawg(dawg_t const *dawg, help_t const *info,
+                                 size_t game, size_t *pending,
+                                 char const *bound) {
+  help_kernels_t const *kernels = help_kernels_select(info->k);
+  size_t printed = 0;
+
+  for (; *pending < dawg->pending_size; (*pending)++) {
+    char const *str = dawg->pending + *pending * (dawg->k + 1);
+    if (bound != NULL && strcmp(str, bound) >= 0)
+      break;
+    if (dawg->pending_filter[*pending] != game &&
+        kernels->compatible(str, info)) {
+      printf("%s\n", str);
+      printed++;
+    }
+  }
+  return printed;
+}
 
-    reset(root->substr, str_occur, substr_idx);
-    return ans;
+static void refresh_required(help_t *info) {
+  info->required_size = 0;
+  for (size_t i = 0; i < info->alphabet_size; i++) {
+    if (info->counters[i].val > 0)
+      info->required[info->required_size++] = (unsigned char)i;
   }
 }
 
-static void reset(char const *str, size_t *occur, size_t up) {
-  for (int i = 0; i <= up; i++) {
+static void reset(help_t const *info, char const *str, size_t *occur,
+                  size_t up) {
+  for (size_t i = 0; i <= up; i++) {
     if (str[i] != '\0')
-      occur[char_index(str[i])]--;
+      occur[info->symbol_index[(unsigned char)str[i]]]--;
   }
 }
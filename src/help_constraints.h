@@ -4,6 +4,7 @@
 #include <stdlib.h>
 
 #include "constants.h"
+#include "dawg.h"
 #include "rax.h"
 
 /*
@@ -30,6 +31,35 @@ help_t *help_alloc(size_t k);
  */
 void help_reset(help_t *info, size_t k);
 
+/*
+ * Adds the characters of a string to the alphabet tracked by help_t. Only the
+ * symbols actually used by the dictionary get a column in the constraint
+ * tables, which keeps them small and their loops short; it must be called on
+ * every string before it is inserted in the dictionary.
+ * Parameters:
+ * - help_t *info: Pointer to the help_t structure
+ * - char const *str: String whose characters are added (null-terminated)
+ */
+void help_add_symbols(help_t *info, char const *str);
+
+/*
+ * Returns the maximum size of the key of a help_t structure (see help_key).
+ * Parameters:
+ * - size_t k: Size of the string in the dictionary
+ */
+size_t help_key_size(size_t k);
+
+/*
+ * Writes the constraints of a help_t structure in canonical form: two
+ * structures with the same alphabet get the same key if and only if they
+ * accept the same strings through the same constraints.
+ * Parameters:
+ * - help_t const *info: Pointer to the help_t structure
+ * - unsigned char *key: Buffer of help_key_size(k) bytes
+ * Returns: Size of the key
+ */
+size_t help_key(help_t const *info, unsigned char *key);
+
 /*
  * Deallocates a help_t structure and its associated memory.
  * Parameters:
@@ -63,11 +93,75 @@ bool compatible(char const *str, help_t const *info);
  * the filter fields of the nodes corresponding to branches of the radix trie
  * that can be pruned away.
  * Parameters:
+ * - memory_allocator_t const *allocator: Allocator holding the radix trie
  * - rax_t *root: Pointer to the root node of the radix trie
  * - help_t *info: Pointer to the help_t structure
  * - int game: Game index
+ * - size_t *counts: If not NULL and the children of the root are nodes,
+ *     receives the number of compatible strings under each of them, in order
+ *     (room for ALPHABET_SIZE counts, one per symbol), e.g. to balance
+ *     rax_print_parallel
+ * - size_t *visited: If not NULL, receives the number of nodes (and buckets)
+ *     visited, i.e. not skipped as already pruned in this game; the nodes are
+ *     then counted by a separate copy of the traversal, so NULL costs nothing
  * Returns: Number of strings in the radix trie compatible with `info`
  */
-size_t update_filter(rax_t *root, help_t *info, size_t game);
+size_t update_filter(memory_allocator_t const *allocator, rax_t *root,
+                     help_t *info, size_t game, size_t *counts,
+                     size_t *visited);
+
+/*
+ * Counts the strings of an automaton (the dictionary in --dawg mode)
+ * compatible with `info`, like update_filter. States are shared by many
+ * paths, so the occurrence constraints, which depend on the path, are checked
+ * on the occurrences counted along the traversal (which also stops as soon as
+ * the characters left cannot satisfy the lower bounds), while the filter of a
+ * state reached by several paths is only set when the position constraints
+ * (can_appear, which only depend on the depth) rule out all of its edges, so
+ * that later guesses of the same game skip it. Pending strings are checked one
+ * by one.
+ * Parameters:
+ * - dawg_t *dawg: Pointer to the automaton
+ * - help_t const *info: Pointer to the help_t structure
+ * - size_t game: Game index
+ * Returns: Number of strings in the automaton compatible with `info`
+ */
+size_t update_filter_dawg(dawg_t *dawg, help_t const *info, size_t game);
+
+/*
+ * Prints the strings of an automaton compatible with `info` in sorted order,
+ * one per line, pruning it as update_filter_dawg does.
+ * Parameters:
+ * - dawg_t *dawg: Pointer to the automaton
+ * - help_t const *info: Pointer to the help_t structure
+ * - size_t game: Game index
+ * Returns: Number of strings printed
+ */
+size_t print_filtered_dawg(dawg_t *dawg, help_t const *info, size_t game);
+
+/*
+ * Kernels used while playing a game, all with the same contract as the
+ * functions above with the same name. Those functions select the kernels for
+ * info->k on each call; loops should select them once instead.
+ */
+typedef struct help_kernels_t {
+  void (*gen_constraint)(char const *ref, char const *guess, char *feedback,
+                         size_t k);
+  void (*help_update)(help_t *info, char const *guess, char const *feedback);
+  bool (*compatible)(char const *str, help_t const *info);
+  size_t (*update_filter)(memory_allocator_t const *allocator, rax_t *root,
+                          help_t *info, size_t game, size_t *counts,
+                          size_t *visited);
+} help_kernels_t;
+
+/*
+ * Selects the kernels for strings of length k: the ones specialized at compile
+ * time for k (see FOR_EACH_FIXED_K in utils.h), whose loops over the string
+ * are fully unrolled, or the generic ones otherwise.
+ * Parameters:
+ * - size_t k: Length of the strings
+ * Returns: Pointer to a statically allocated table of kernels
+ */
+help_kernels_t const *help_kernels_select(size_t k);
 
 #endif // HELP_CONSTRAINTS_H
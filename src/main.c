@@ -4,26 +4,235 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "command_log.h"
 #include "constants.h"
+#include "dawg.h"
+#include "filter_cache.h"
 #include "help_constraints.h"
 #include "memory_allocator.h"
 #include "rax.h"
+#include "trace.h"
 #include "utils.h"
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 #define MIN_ARENA_SIZE 1024
 
+// default fraction of the arena released by splits and bursts above which the
+// dictionary is compacted between games
+#define MAX_WASTE_RATIO 0.25
+
+// minimum number of filtered strings for PRINT_FILTERED to use several threads
+#define PARALLEL_PRINT_MIN (1 << 14)
+
+// maximum length of the numbers in the input
+#define MAX_NUMBER 20
+
+// number of strings fetched from the dictionary at a time while printing a
+// page
+#define PAGE_CHUNK 64
+
+/*
+ * Creates the allocator holding the dictionary: in memory, or mapped from the
+ * file at arena_path if it is not NULL.
+ */
+static memory_allocator_t *new_allocator(char const *arena_path, size_t k) {
+  size_t block_size = MAX(1024 * k, MIN_ARENA_SIZE);
+
+  if (arena_path == NULL)
+    return init_memory_allocator(block_size);
+
+  memory_allocator_t *allocator =
+      init_memory_allocator_mapped(arena_path, block_size);
+  if (allocator == NULL) {
+    fprintf(stderr, "error: cannot create %s\n", arena_path);
+    exit(EXIT_FAILURE);
+  }
+  return allocator;
+}
+
+/*
+ * Compacts the dictionary: copies it into a fresh allocator in depth-first
+ * order (see rax_cluster), leaving behind the memory released by splits and
+ * bursts, and frees the old allocator.
+ * Returns: Number of bytes reclaimed
+ */
+static size_t compact(char const *arena_path, size_t k,
+                      memory_allocator_t **allocator, rax_t **dict) {
+  memory_stats_t before, after;
+  memory_allocator_t *compacted = new_allocator(arena_path, k);
+
+  memory_get_stats(*allocator, &before);
+  *dict = rax_cluster(*allocator, *dict, compacted);
+  deallocate(*allocator);
+  *allocator = compacted;
+  memory_get_stats(*allocator, &after);
+
+  return before.bytes_used > after.bytes_used
+             ? before.bytes_used - after.bytes_used
+             : 0;
+}
+
+/*
+ * Prints the next page of an iteration over the dictionary, one string per
+ * line, fetching PAGE_CHUNK strings at a time into chunk.
+ * Returns: Number of strings printed (less than page_size only at the end of
+ *   the iteration)
+ */
+static size_t print_page(memory_allocator_t const *allocator,
+                         rax_t const *dict, rax_iter_t *iter, char *chunk,
+                         size_t page_size) {
+  size_t printed = 0, fetched;
+
+  do {
+    size_t wanted = page_size - printed;
+    if (wanted > PAGE_CHUNK)
+      wanted = PAGE_CHUNK;
+    fetched = rax_iter_next(allocator, dict, iter, chunk, wanted);
+    for (size_t i = 0; i < fetched; i++)
+      printf("%s\n", chunk + i * (iter->k + 1));
+    printed += fetched;
+  } while (printed < page_size && !rax_iter_done(iter));
+
+  return printed;
+}
+
+/*
+ * Reads a size (see command_log_read).
+ * Returns: false at the end of the input or if the token is not a number
+ */
+static bool read_size(command_log_t *log, size_t *value) {
+  char token[MAX_NUMBER + 1], *end;
+
+  if (!command_log_read(log, token, sizeof(token)))
+    return false;
+  *value = strtoul(token, &end, 10);
+  return end != token;
+}
+
+/*
+ * Ends the current command and reads the first token of the next one.
+ * Returns: false at the end of the input
+ */
+static bool next_command(command_log_t *log, char *input, size_t size) {
+  command_log_end(log);
+  return command_log_read(log, input, size);
+}
+
 int main(int argc, char *argv[]) {
+  // command line options:
+  // - --arena FILE: keep the dictionary in FILE rather than in memory
+  // - --stats: print the statistics of the dictionary and of its allocator on
+  //   exit, and the bytes reclaimed by each compaction (to stderr)
+  // - --max-waste RATIO: compact the dictionary between games when more than
+  //   RATIO of its arena is wasted (1 to never do it)
+  // - --trace FILE: record the spans of the commands and of their phases, and
+  //   write them to FILE on exit as Chrome trace JSON
+  // - --trace-events N: keep only the last N spans (TRACE_DEFAULT_CAPACITY by
+  //   default)
+  // - --print-threads N: format large filtered dictionaries with up to N
+  //   threads (1 by default)
+  // - --filter-cache N: keep the strings pruned by up to N constraint states
+  //   across games (0 by default: insertions clear the cache, so it only
+  //   pays off on workloads repeating games between them)
+  // - --record LOG: record the input with timestamps, and the output, into LOG
+  //   (see command_log.h)
+  // - --replay LOG: read the input from LOG rather than from the standard
+  //   input, then print the throughput and the latencies of the commands and
+  //   check the output against the recorded one (to stderr)
+  // - --paced: replay each command at its recorded time rather than as fast as
+  //   possible
+  // - --dawg: keep the dictionary as a minimal automaton (see dawg.h) rather
+  //   than as a radix trie once it is loaded (paging and the filter cache are
+  //   not available)
+  char const *arena_path = NULL, *trace_path = NULL;
+  char const *record_path = NULL, *replay_path = NULL;
+  bool print_stats = false, paced = false, use_dawg = false;
+  double max_waste = MAX_WASTE_RATIO;
+  size_t trace_events = TRACE_DEFAULT_CAPACITY, print_threads = 1;
+  size_t cache_entries = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--arena") == 0 && i + 1 < argc) {
+      arena_path = argv[++i];
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      print_stats = true;
+    } else if (strcmp(argv[i], "--max-waste") == 0 && i + 1 < argc) {
+      max_waste = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      trace_path = argv[++i];
+    } else if (strcmp(argv[i], "--trace-events") == 0 && i + 1 < argc) {
+      trace_events = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--print-threads") == 0 && i + 1 < argc) {
+      print_threads = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--filter-cache") == 0 && i + 1 < argc) {
+      cache_entries = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc &&
+               replay_path == NULL) {
+      record_path = argv[++i];
+    } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc &&
+               record_path == NULL) {
+      replay_path = argv[++i];
+    } else if (strcmp(argv[i], "--paced") == 0) {
+      paced = true;
+    } else if (strcmp(argv[i], "--dawg") == 0) {
+      use_dawg = true;
+    } else {
+      fprintf(stderr,
+              "usage: %s [--arena FILE] [--stats] [--max-waste RATIO] "
+              "[--trace FILE [--trace-events N]] [--print-threads N] "
+              "[--filter-cache N] [--record LOG | --replay LOG [--paced]] "
+              "[--dawg]\n",
+              argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  command_log_t *log = NULL;
+  if (record_path != NULL) {
+    log = command_log_record(record_path);
+    if (log == NULL) {
+      fprintf(stderr, "error: cannot create %s\n", record_path);
+      return EXIT_FAILURE;
+    }
+  } else if (replay_path != NULL) {
+    log = command_log_replay(replay_path, paced);
+    if (log == NULL) {
+      fprintf(stderr, "error: cannot replay %s\n", replay_path);
+      return EXIT_FAILURE;
+    }
+  }
+
+  FILE *trace_file = NULL;
+  if (trace_path != NULL) {
+    trace_file = fopen(trace_path, "w");
+    if (trace_file == NULL) {
+      fprintf(stderr, "error: cannot create %s\n", trace_path);
+      return EXIT_FAILURE;
+    }
+    trace_start(trace_events > 0 ? trace_events : 1);
+  }
+
   // read the length of the strings
   size_t k;
-  if (scanf("%zu", &k) != 1)
+  if (!read_size(log, &k))
     fprintf(stderr, "error taking k\n");
 
   // initialize empty dictionary and allocator
-  memory_allocator_t *allocator =
-      init_memory_allocator(MAX(1024 * k, MIN_ARENA_SIZE));
+  memory_allocator_t *allocator = new_allocator(arena_path, k);
   rax_t *dict = rax_alloc(allocator);
 
+  // data structures to keep track of the constraints, and the kernels
+  // specialized for k
+  help_t *info = help_alloc(k);
+  help_kernels_t const *kernels = help_kernels_select(k);
+
+  // strings pruned by the constraint states met so far, and buffer for the
+  // key of the current one
+  filter_cache_t *cache =
+      cache_entries > 0
+          ? filter_cache_alloc(cache_entries, FILTER_CACHE_DEFAULT_BYTES)
+          : NULL;
+  unsigned char *cache_key = (unsigned char *)malloc(help_key_size(k));
+
   // initialize the input buffer
   size_t input_size = MAX_KEYWORD;
   if (k > input_size)
@@ -32,72 +241,247 @@ int main(int argc, char *argv[]) {
 
   // building the radix trie
   size_t dict_size = 0, game = 0;
-  if (scanf("%s", input) != 1)
+  uint64_t command_start = trace_begin(), phase_start;
+  if (!command_log_read(log, input, sizeof(input)))
     fprintf(stderr, "error taking input while building dict\n");
   while (input[0] != '+') {
     // insert the word into the dictionary and increment the dictionary size
+    help_add_symbols(info, input);
+    phase_start = trace_begin();
     rax_insert(allocator, dict, input, k, game);
+    trace_end("rax_insert", phase_start, NULL, 0, NULL, 0);
     dict_size++;
 
-    if (scanf("%s", input) != 1)
+    if (!command_log_read(log, input, sizeof(input)))
       fprintf(stderr, "error taking input while building dict\n");
   }
 
-  // data structures to keep track of the constraints
-  help_t *info = help_alloc(k);
-  char constraint[k + 1], ref[k + 1], my_str[k + 1];
+  size_t reclaimed = 0;
+  dawg_t *dawg = NULL;
+  if (use_dawg) {
+    // the trie sorts the words: build their automaton from it, then free it
+    // (an empty trie is left for the paging commands), and drop the filter
+    // cache, whose entries record nodes of the trie
+    phase_start = trace_begin();
+    dawg = dawg_from_rax(allocator, dict, k);
+    deallocate(allocator);
+    allocator = new_allocator(arena_path, k);
+    dict = rax_alloc(allocator);
+    if (cache != NULL) {
+      filter_cache_dealloc(cache);
+      cache = NULL;
+    }
+    trace_end("dawg_build", phase_start, "states", dawg->states_size, "edges",
+              dawg->edges_size);
+  } else {
+    // lay the dictionary out in depth-first order (words arrive in no
+    // particular order, so the subtrees are scattered over the allocator)
+    phase_start = trace_begin();
+    reclaimed = compact(arena_path, k, &allocator, &dict);
+    trace_end("compact", phase_start, "bytes_reclaimed", reclaimed, NULL, 0);
+    if (print_stats)
+      fprintf(stderr, "compaction: %zu bytes reclaimed\n", reclaimed);
+  }
+  trace_end("load_dictionary", command_start, "words", dict_size, NULL, 0);
+
+  char constraint[k + 1], ref[k + 1];
+  char page[PAGE_CHUNK * (k + 1)];
+  rax_iter_t *iter = rax_iter_alloc(k);
   size_t guess_counter = 0;
-  size_t filtered_size, n;
+  size_t filtered_size, n, page_size;
+
+  // filtered strings under each child of the root, as counted by the last
+  // update_filter (NULL if not counted since the dictionary last changed)
+  size_t root_counts[ALPHABET_SIZE];
+  size_t *filtered_counts = NULL;
+
+  // strings inserted by the current insertion block in --dawg mode, added to
+  // the automaton at its end
+  char *inserts = NULL;
+  size_t inserts_capacity = 0;
 
   do {
+    command_start = trace_begin();
+    command_log_begin(log);
+
     if (strncmp(input, NEW_GAME, strlen(NEW_GAME) + 1) == 0) {
       // new_game command
 
+      // compact the dictionary if the insertions since the last compaction
+      // left too much memory unused
+      memory_stats_t stats;
+      memory_get_stats(allocator, &stats);
+      if (dawg == NULL && stats.bytes_free > max_waste * stats.bytes_used) {
+        phase_start = trace_begin();
+        reclaimed = compact(arena_path, k, &allocator, &dict);
+        if (cache != NULL)
+          filter_cache_clear(cache);
+        trace_end("compact", phase_start, "bytes_reclaimed", reclaimed, NULL,
+                  0);
+        if (print_stats)
+          fprintf(stderr, "compaction: %zu bytes reclaimed\n", reclaimed);
+      }
+
       // reset the filtered_size and count compare and change the game index
       filtered_size = dict_size;
-      game++;
+      filtered_counts = NULL;
+      game = dawg != NULL ? dawg_next_epoch(dawg, game)
+                          : rax_next_epoch(allocator, dict, game);
       guess_counter = 0;
 
       // reset the constraint info struct
       help_reset(info, k);
 
-      if (scanf("%s", ref) != 1)
+      // page through the filtered dictionary of this game from its start
+      rax_iter_reset(iter, game, "");
+
+      if (!command_log_read(log, ref, sizeof(ref)))
         fprintf(stderr, "error taking ref at beginning of new game\n");
-      if (scanf("%zu", &n) != 1)
+      if (!read_size(log, &n))
         fprintf(stderr, "error taking n at beginning of new game\n");
 
+      trace_end("new_game", command_start, "words", dict_size, "guesses", n);
+
     } else if (strncmp(input, INSERT_START, strlen(INSERT_START) + 1) == 0) {
       // insert_start command
 
-      if (scanf("%s", input) == 0)
+      size_t inserted = 0;
+      filtered_counts = NULL;
+
+      // the cached pruned strings refer to nodes that insertions may replace
+      if (cache != NULL)
+        filter_cache_clear(cache);
+      if (!command_log_read(log, input, sizeof(input)))
         fprintf(stderr, "error taking input during insertion\n");
       while (strncmp(input, INSERT_END, strlen(INSERT_END) + 1) != 0) {
-        if (compatible(input, info)) {
+        help_add_symbols(info, input);
+        phase_start = trace_begin();
+        if (dawg != NULL) {
+          // collect the string, and count it if it is compatible with the
+          // constraints
+          if (inserted == inserts_capacity) {
+            inserts_capacity =
+                inserts_capacity == 0 ? 64 : 2 * inserts_capacity;
+            inserts = (char *)realloc(inserts, inserts_capacity * (k + 1));
+          }
+          memcpy(inserts + inserted * (k + 1), input, k + 1);
+          filtered_size += kernels->compatible(input, info);
+        } else if (kernels->compatible(input, info)) {
           // if the input is compatible with the constraints, it will be part of
           // the filtered dictionary
           rax_insert(allocator, dict, input, k, 0);
           filtered_size++;
+          trace_end("rax_insert", phase_start, "filtered_out", 0, NULL, 0);
         } else {
           // if the input is not compatible with the constraints, it will not be
           // part of the filtered dictionary
           rax_insert(allocator, dict, input, k, game);
+          trace_end("rax_insert", phase_start, "filtered_out", 1, NULL, 0);
         }
 
         // increment the dictionary size because an element has been inserted in
         // the dictionary
         dict_size++;
+        inserted++;
 
-        if (scanf("%s", input) != 1)
+        if (!command_log_read(log, input, sizeof(input)))
           fprintf(stderr, "error taking input during insertion\n");
       }
 
+      if (dawg != NULL) {
+        // prune the automaton again if it was rebuilt during a game
+        phase_start = trace_begin();
+        bool rebuilt = dawg_insert(dawg, inserts, inserted);
+        if (rebuilt && game > 0)
+          update_filter_dawg(dawg, info, game);
+        trace_end("dawg_insert", phase_start, "rebuilt", rebuilt, "pending",
+                  dawg->pending_size);
+      }
+
+      trace_end("insert", command_start, "words", inserted, "filtered",
+                filtered_size);
+
+    } else if (strncmp(input, COMPACT, strlen(COMPACT) + 1) == 0) {
+      // compact command
+
+      reclaimed = compact(arena_path, k, &allocator, &dict);
+      if (cache != NULL)
+        filter_cache_clear(cache);
+      fprintf(stderr, "compaction: %zu bytes reclaimed\n", reclaimed);
+      trace_end("compact", command_start, "bytes_reclaimed", reclaimed, NULL,
+                0);
+
     } else if (strncmp(input, PRINT_FILTERED, strlen(PRINT_FILTERED) + 1) ==
                0) {
       // print_filtered command
 
       // print the strings in the dictionary that are part of the filtered
       // dictionary
-      rax_print(dict, my_str, game);
+      size_t printed;
+      if (dawg != NULL) {
+        phase_start = trace_begin();
+        printed = print_filtered_dawg(dawg, info, game);
+        trace_end("dawg_print", phase_start, "words", printed, NULL, 0);
+      } else {
+        memory_advise(allocator, MEMORY_ADVICE_SEQUENTIAL);
+        phase_start = trace_begin();
+        size_t threads =
+            filtered_size >= PARALLEL_PRINT_MIN ? print_threads : 1;
+        printed = rax_print_parallel(allocator, dict, k, game, filtered_counts,
+                                     threads);
+        trace_end("rax_print", phase_start, "words", printed, "threads",
+                  threads);
+        memory_advise(allocator, MEMORY_ADVICE_NORMAL);
+      }
+
+      trace_end("print_filtered", command_start, "words", printed,
+                "bytes_written", printed * (k + 1));
+
+    } else if (strncmp(input, PRINT_PREFIX, strlen(PRINT_PREFIX) + 1) == 0) {
+      // print_prefix command
+
+      // restart paging from the first filtered string with the prefix, then
+      // print the first page
+      if (!command_log_read(log, input, sizeof(input)))
+        fprintf(stderr, "error taking prefix\n");
+      rax_iter_reset(iter, game, input);
+      if (!read_size(log, &page_size))
+        fprintf(stderr, "error taking page size\n");
+      size_t printed = 0;
+      if (dawg != NULL)
+        fprintf(stderr, "error: paging is not available with --dawg\n");
+      else
+        printed = print_page(allocator, dict, iter, page, page_size);
+
+      trace_end("print_page", command_start, "words", printed, "done",
+                rax_iter_done(iter));
+
+    } else if (strncmp(input, PRINT_PAGE, strlen(PRINT_PAGE) + 1) == 0) {
+      // print_page command
+
+      // print the next page, after the last string printed
+      if (!read_size(log, &page_size))
+        fprintf(stderr, "error taking page size\n");
+      size_t printed = 0;
+      if (dawg != NULL)
+        fprintf(stderr, "error: paging is not available with --dawg\n");
+      else
+        printed = print_page(allocator, dict, iter, page, page_size);
+
+      trace_end("print_page", command_start, "words", printed, "done",
+                rax_iter_done(iter));
+
+    } else if (strncmp(input, RESUME, strlen(RESUME) + 1) == 0) {
+      // resume command
+
+      // the next page starts after the given string (a cursor saved from a
+      // previous page), keeping the prefix
+      if (!command_log_read(log, input, sizeof(input)) || strlen(input) != k)
+        fprintf(stderr, "error taking cursor\n");
+      else
+        rax_iter_seek(iter, input);
+
+      trace_end("resume", command_start, NULL, 0, NULL, 0);
 
     } else {
       // processing a guess against the reference word
@@ -105,13 +489,16 @@ int main(int argc, char *argv[]) {
       // if the guess is the reference word, print ok and the game ends
       if (strncmp(input, ref, k + 1) == 0) {
         printf("ok\n");
+        trace_end("guess", command_start, "ok", 1, NULL, 0);
         continue;
       }
 
       // if the guess is not present in the dictionary, print that it does not
       // exist
-      if (rax_search(dict, input) == 0) {
+      if (dawg != NULL ? !dawg_search(dawg, input)
+                       : rax_search(allocator, dict, input) == 0) {
         printf("not_exists\n");
+        trace_end("guess", command_start, "exists", 0, NULL, 0);
         continue;
       }
 
@@ -119,13 +506,68 @@ int main(int argc, char *argv[]) {
       guess_counter++;
 
       // generate the constraint and update the constraints
-      gen_constraint(ref, input, constraint, k);
-      help_update(info, input, constraint);
+      phase_start = trace_begin();
+      kernels->gen_constraint(ref, input, constraint, k);
+      trace_end("gen_constraint", phase_start, NULL, 0, NULL, 0);
+      phase_start = trace_begin();
+      kernels->help_update(info, input, constraint);
+      trace_end("help_update", phase_start, NULL, 0, NULL, 0);
       printf("%s\n", constraint);
 
-      // update the filtered dictionary and print its size
-      filtered_size = update_filter(dict, info, game);
+      // update the filtered dictionary and print its size: restore it if
+      // the constraints were met before, filter the trie otherwise
+      size_t previous_size = filtered_size, key_size = 0;
+      uint64_t key_hash = 0;
+      filter_cache_entry_t const *cached = NULL;
+      if (cache != NULL) {
+        key_size = help_key(info, cache_key);
+        key_hash = filter_cache_hash(cache_key, key_size);
+        cached = filter_cache_find(cache, cache_key, key_size, key_hash);
+      }
+
+      if (dawg != NULL) {
+        phase_start = trace_begin();
+        filtered_size = update_filter_dawg(dawg, info, game);
+        trace_end("update_filter", phase_start, "pruned",
+                  previous_size - filtered_size, NULL, 0);
+      } else if (cached != NULL) {
+        phase_start = trace_begin();
+        rax_pruned_apply(allocator, dict, cached->pruned, game);
+        filtered_size = cached->count;
+        filtered_counts = NULL;
+        trace_end("filter_cache_hit", phase_start, "filtered", filtered_size,
+                  "nodes", cached->pruned->nodes_size);
+      } else {
+        memory_advise(allocator, MEMORY_ADVICE_SEQUENTIAL);
+        phase_start = trace_begin();
+        // counting the visited nodes slows the traversal down, so they are
+        // only counted for the span
+        size_t visited = 0;
+        filtered_size =
+            kernels->update_filter(allocator, dict, info, game, root_counts,
+                                   trace_enabled() ? &visited : NULL);
+        filtered_counts = root_counts;
+        // the filtered size is recorded by the guess span
+        trace_end("update_filter", phase_start, "pruned",
+                  previous_size - filtered_size, "visited", visited);
+
+        if (cache != NULL && filter_cache_admit(cache, key_hash)) {
+          phase_start = trace_begin();
+          rax_pruned_t *pruned = rax_pruned_save(allocator, dict, game);
+          // the cache owns the record from now on, and frees it right away if
+          // it is too large to be kept
+          size_t nodes_size = pruned->nodes_size;
+          size_t buckets_size = pruned->buckets_size;
+          filter_cache_store(cache, cache_key, key_size, key_hash,
+                             filtered_size, pruned);
+          trace_end("filter_cache_store", phase_start, "nodes", nodes_size,
+                    "buckets", buckets_size);
+        }
+        memory_advise(allocator, MEMORY_ADVICE_NORMAL);
+      }
       printf("%zu\n", filtered_size);
+      trace_end("guess", command_start, "filtered", filtered_size, "guesses",
+                guess_counter);
 
       // if the maximum number of guesses has been reached, end the game for ko
       if (guess_counter == n) {
@@ -134,11 +576,55 @@ int main(int argc, char *argv[]) {
       }
     }
 
-  } while (scanf("%s", input) != EOF);
+  } while (next_command(log, input, sizeof(input)));
+
+  // stop recording, or report on the replay
+  bool replay_ok = log == NULL || command_log_close(log, stderr);
+
+  if (print_stats) {
+    // shape of the dictionary (with the nodes pruned in the last game), then
+    // usage of its arena
+    if (dawg != NULL) {
+      fprintf(stderr,
+              "dawg: %zu strings, %zu pending, %zu states, %zu edges, %zu "
+              "bytes\n",
+              dawg->strings, dawg->pending_size, dawg->states_size,
+              dawg->edges_size, dawg_bytes(dawg));
+    } else {
+      rax_stats_t dict_stats;
+      rax_stats(allocator, dict, game, &dict_stats);
+      rax_stats_print(stderr, &dict_stats);
+    }
+
+    memory_stats_t stats;
+    memory_get_stats(allocator, &stats);
+    fprintf(stderr,
+            "arena: %zu blocks, %zu bytes reserved, %zu bytes used, %zu bytes "
+            "free\n",
+            stats.blocks_count, stats.bytes_reserved, stats.bytes_used,
+            stats.bytes_free);
+    fprintf(stderr, "page faults: %zu minor, %zu major\n", stats.minor_faults,
+            stats.major_faults);
+    if (cache != NULL)
+      filter_cache_print_stats(stderr, cache);
+  }
+
+  if (trace_file != NULL) {
+    trace_dump(trace_file);
+    fclose(trace_file);
+  }
 
-  // deallocate the radix trie (managed by allocator) and the info struct
+  // deallocate the radix trie (managed by allocator) or the automaton, the
+  // info struct, the iterator and the cache
   deallocate(allocator);
+  if (dawg != NULL)
+    dawg_dealloc(dawg);
+  free(inserts);
   help_dealloc(info);
+  rax_iter_dealloc(iter);
+  if (cache != NULL)
+    filter_cache_dealloc(cache);
+  free(cache_key);
 
-  return 0;
+  return replay_ok ? 0 : EXIT_FAILURE;
 }
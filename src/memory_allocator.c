@@ -1,80 +1,176 @@
+#define _XOPEN_SOURCE 700
+
+#include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
+#include "ebr.h"
 #include "memory_allocator.h"
 
-typedef struct memory_block_t {
-  void *start_ptr;
-  void *current_ptr;
-  void *end_ptr;
-} memory_block_t;
+static memory_allocator_t *init_allocator(int fd, size_t block_size);
+static void allocate_block(memory_allocator_t *allocator, size_t block_size);
 
-typedef struct memory_block_list_node_t {
-  memory_block_t block;
-  struct memory_block_list_node_t *next;
-} memory_block_list_node_t;
+memory_allocator_t *init_memory_allocator(size_t block_size) {
+  return init_allocator(-1, block_size);
+}
 
-typedef struct memory_allocator_t {
-  memory_block_list_node_t *blocks_list;
-  size_t block_size;
-} memory_allocator_t;
+memory_allocator_t *init_memory_allocator_mapped(char const *path,
+                                                 size_t block_size) {
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0)
+    return NULL;
+  unlink(path);
 
-static memory_block_list_node_t *allocate_block_list_node(size_t block_size);
-static void deallocate_block_list_node(memory_block_list_node_t *node);
+  return init_allocator(fd, block_size);
+}
 
-memory_allocator_t *init_memory_allocator(size_t block_size) {
+memory_allocator_t *init_allocator(int fd, size_t block_size) {
   memory_allocator_t *allocator =
       (memory_allocator_t *)malloc(sizeof(memory_allocator_t));
-  allocator->block_size = block_size;
-  allocator->blocks_list = allocate_block_list_node(block_size);
+  allocator->blocks_count = 0;
+  allocator->ebr = NULL;
+  allocator->fd = fd;
+  allocator->file_size = 0;
+  allocator->bytes_free = 0;
+  for (size_t i = 0; i < MEMORY_FREE_LISTS; i++) {
+    allocator->free_lists[i] = MEMORY_NULL_REF;
+  }
+  allocate_block(allocator, block_size);
+
+  // the first bytes of the first block are never handed out, so that
+  // MEMORY_NULL_REF does not refer to allocated memory
+  allocator->current_ptr += MEMORY_ALIGNMENT;
   return allocator;
 }
 
-void *allocate(memory_allocator_t *allocator, size_t size) {
-  if (size > allocator->block_size) {
-    allocator->block_size = size;
-    return allocate(allocator, size);
+memory_ref_t allocate(memory_allocator_t *allocator, size_t size) {
+  size = (size + MEMORY_ALIGNMENT - 1) / MEMORY_ALIGNMENT * MEMORY_ALIGNMENT;
+
+  // reuse released memory of the same size, if any
+  if (size / MEMORY_ALIGNMENT < MEMORY_FREE_LISTS &&
+      allocator->free_lists[size / MEMORY_ALIGNMENT] != MEMORY_NULL_REF) {
+    memory_ref_t *head = &allocator->free_lists[size / MEMORY_ALIGNMENT];
+    memory_ref_t ref = *head;
+    memcpy(head, memory_deref(allocator, ref), sizeof(memory_ref_t));
+    allocator->bytes_free -= size;
+    return ref;
   }
 
-  if ((char *)allocator->blocks_list->block.current_ptr + size <=
-      (char *)allocator->blocks_list->block.end_ptr) {
-    void *ptr = allocator->blocks_list->block.current_ptr;
-    allocator->blocks_list->block.current_ptr =
-        (char *)allocator->blocks_list->block.current_ptr + size;
-    return ptr;
+  if (allocator->current_ptr + size > allocator->end_ptr) {
+    size_t block_size = 2 * allocator->block_size;
+    if (block_size > MEMORY_MAX_BLOCK_SIZE)
+      block_size = MEMORY_MAX_BLOCK_SIZE;
+    if (size > block_size)
+      block_size = size;
+    allocate_block(allocator, block_size);
   }
 
-  memory_block_list_node_t *new_blocks_list_node =
-      allocate_block_list_node(allocator->block_size);
-  new_blocks_list_node->next = allocator->blocks_list;
-  allocator->blocks_list = new_blocks_list_node;
-  return allocate(allocator, size);
+  size_t block = allocator->blocks_count - 1;
+  size_t offset = (size_t)(allocator->current_ptr - allocator->blocks[block]);
+  allocator->current_ptr += size;
+  return (memory_ref_t)(block << MEMORY_OFFSET_BITS |
+                        offset / MEMORY_ALIGNMENT);
 }
 
-void deallocate(memory_allocator_t *allocator) {
-  memory_block_list_node_t *current = allocator->blocks_list;
-  memory_block_list_node_t *next;
+void release(memory_allocator_t *allocator, memory_ref_t ref, size_t size) {
+  size_t list = (size + MEMORY_ALIGNMENT - 1) / MEMORY_ALIGNMENT;
+
+  allocator->bytes_free += list * MEMORY_ALIGNMENT;
+  if (list >= MEMORY_FREE_LISTS)
+    return; // too large to be worth reusing
+
+  memcpy(memory_deref(allocator, ref), &allocator->free_lists[list],
+         sizeof(memory_ref_t));
+  allocator->free_lists[list] = ref;
+}
+
+void retire(memory_allocator_t *allocator, memory_ref_t ref, size_t size) {
+  if (allocator->ebr != NULL)
+    ebr_retire(allocator->ebr, ref, size);
+  else
+    release(allocator, ref, size);
+}
+
+void memory_advise(memory_allocator_t const *allocator,
+                   memory_advice_t advice) {
+  if (allocator->fd < 0)
+    return;
 
-  while (current != NULL) {
-    next = current->next;
-    deallocate_block_list_node(current);
-    current = next;
+  int posix_advice = advice == MEMORY_ADVICE_SEQUENTIAL ? POSIX_MADV_SEQUENTIAL
+                                                        : POSIX_MADV_NORMAL;
+  for (size_t i = 0; i < allocator->blocks_count; i++) {
+    posix_madvise(allocator->blocks[i], allocator->block_sizes[i],
+                  posix_advice);
   }
+}
 
-  free(allocator);
+void memory_get_stats(memory_allocator_t const *allocator,
+                      memory_stats_t *stats) {
+  struct rusage usage;
+
+  stats->blocks_count = allocator->blocks_count;
+  stats->bytes_reserved = 0;
+  for (size_t i = 0; i < allocator->blocks_count; i++) {
+    stats->bytes_reserved += allocator->block_sizes[i];
+  }
+  stats->bytes_used = stats->bytes_reserved -
+                      (size_t)(allocator->end_ptr - allocator->current_ptr);
+  stats->bytes_free = allocator->bytes_free;
+
+  getrusage(RUSAGE_SELF, &usage);
+  stats->minor_faults = (size_t)usage.ru_minflt;
+  stats->major_faults = (size_t)usage.ru_majflt;
 }
 
-memory_block_list_node_t *allocate_block_list_node(size_t block_size) {
-  memory_block_list_node_t *block_list_node =
-      (memory_block_list_node_t *)malloc(sizeof(memory_block_list_node_t));
-  block_list_node->block.start_ptr = malloc(block_size);
-  block_list_node->block.current_ptr = block_list_node->block.start_ptr;
-  block_list_node->block.end_ptr =
-      (char *)block_list_node->block.start_ptr + block_size;
-  block_list_node->next = NULL;
-  return block_list_node;
+void deallocate(memory_allocator_t *allocator) {
+  for (size_t i = 0; i < allocator->blocks_count; i++) {
+    if (allocator->fd < 0)
+      free(allocator->blocks[i]);
+    else
+      munmap(allocator->blocks[i], allocator->block_sizes[i]);
+  }
+
+  if (allocator->fd >= 0)
+    close(allocator->fd);
+  free(allocator);
 }
 
-void deallocate_block_list_node(memory_block_list_node_t *node) {
-  free(node->block.start_ptr);
-  free(node);
+void allocate_block(memory_allocator_t *allocator, size_t block_size) {
+  if (allocator->blocks_count == MEMORY_MAX_BLOCKS ||
+      block_size > MEMORY_MAX_BLOCK_SIZE) {
+    fprintf(stderr, "error: memory allocator out of handles\n");
+    exit(EXIT_FAILURE);
+  }
+
+  char *block;
+  if (allocator->fd < 0) {
+    block = (char *)malloc(block_size);
+  } else {
+    // blocks are mapped at page-aligned offsets of the file
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    block_size = (block_size + page_size - 1) / page_size * page_size;
+
+    if (ftruncate(allocator->fd, (off_t)(allocator->file_size + block_size)) !=
+        0) {
+      fprintf(stderr, "error: cannot grow the memory allocator file\n");
+      exit(EXIT_FAILURE);
+    }
+    block = (char *)mmap(NULL, block_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         allocator->fd, (off_t)allocator->file_size);
+    if (block == (char *)MAP_FAILED) {
+      fprintf(stderr, "error: cannot map the memory allocator file\n");
+      exit(EXIT_FAILURE);
+    }
+    allocator->file_size += block_size;
+  }
+
+  allocator->block_sizes[allocator->blocks_count] = block_size;
+  allocator->blocks[allocator->blocks_count++] = block;
+  allocator->current_ptr = block;
+  allocator->end_ptr = block + block_size;
+  allocator->block_size = block_size;
 }
@@ -1,26 +1,182 @@
 #ifndef MEMORY_ARENA_H
 #define MEMORY_ARENA_H
 
+#include <stdint.h>
 #include <stdlib.h>
 
-typedef struct memory_allocator_t memory_allocator_t;
+/*
+ * Memory handed out by the allocator is referred to by 32-bit handles rather
+ * than pointers: the upper 32 - MEMORY_OFFSET_BITS bits are the index of the
+ * block, the lower ones the offset within the block in units of
+ * MEMORY_ALIGNMENT bytes. Hence, blocks are at most MEMORY_MAX_BLOCK_SIZE
+ * bytes, and there are at most MEMORY_MAX_BLOCKS of them (16 GiB overall).
+ * The handle MEMORY_NULL_REF never refers to allocated memory.
+ */
+#define MEMORY_ALIGNMENT 4
+#define MEMORY_OFFSET_BITS 20
+#define MEMORY_MAX_BLOCK_SIZE ((size_t)MEMORY_ALIGNMENT << MEMORY_OFFSET_BITS)
+#define MEMORY_MAX_BLOCKS ((size_t)1 << (32 - MEMORY_OFFSET_BITS))
+#define MEMORY_NULL_REF ((memory_ref_t)0)
+
+/*
+ * Released memory is kept in a free list per size (in units of
+ * MEMORY_ALIGNMENT) for sizes smaller than MEMORY_FREE_LISTS *
+ * MEMORY_ALIGNMENT bytes; larger chunks are not reused.
+ */
+#define MEMORY_FREE_LISTS 128
+
+typedef uint32_t memory_ref_t;
+
+struct ebr_t;
+
+/*
+ * Access patterns the allocator can be told about (see memory_advise). They
+ * are only hints to the kernel, and only matter for file-backed allocators.
+ */
+typedef enum memory_advice_t {
+  MEMORY_ADVICE_NORMAL,
+  MEMORY_ADVICE_SEQUENTIAL,
+} memory_advice_t;
+
+/*
+ * Statistics of an allocator.
+ * Members:
+ * - size_t blocks_count:   Number of blocks
+ * - size_t bytes_reserved: Overall size of the blocks
+ * - size_t bytes_used:     Bytes handed out so far (including the ends of the
+ *     blocks too small for the allocations that followed), released or not
+ * - size_t bytes_free:     Bytes released and not handed out again
+ * - size_t minor_faults, major_faults: Page faults of the whole process so
+ *     far, without and with I/O
+ */
+typedef struct memory_stats_t {
+  size_t blocks_count;
+  size_t bytes_reserved;
+  size_t bytes_used;
+  size_t bytes_free;
+  size_t minor_faults;
+  size_t major_faults;
+} memory_stats_t;
+
+/*
+ * Memory allocator handing out memory from large blocks, released all at once.
+ * Members:
+ * - char *blocks[]:     Start of the blocks, in allocation order
+ * - size_t blocks_count: Number of blocks allocated so far
+ * - char *current_ptr:  Start of the free memory in the last block
+ * - char *end_ptr:      End of the last block
+ * - size_t block_size:  Size of the last block (each block doubles the size of
+ *     the previous one, up to MEMORY_MAX_BLOCK_SIZE)
+ * - memory_ref_t free_lists[]: Head of the free list of each size, linked
+ *     through the first 4 bytes of the released chunks
+ * - struct ebr_t *ebr:  Reclamation domain deferring `retire` while readers
+ *     may still access retired memory (NULL if there are no such readers)
+ * - int fd:             File the blocks are mapped from, or -1 if they are
+ *     allocated with malloc
+ * - size_t file_size:   Size of the file (the blocks are mapped one after the
+ *     other)
+ * - size_t block_sizes[]: Size of each block
+ * - size_t bytes_free:  Bytes released and not handed out again (including
+ *     the chunks too large for the free lists, which are never reused)
+ */
+typedef struct memory_allocator_t {
+  char *blocks[MEMORY_MAX_BLOCKS];
+  size_t block_sizes[MEMORY_MAX_BLOCKS];
+  size_t blocks_count;
+  char *current_ptr;
+  char *end_ptr;
+  size_t block_size;
+  memory_ref_t free_lists[MEMORY_FREE_LISTS];
+  struct ebr_t *ebr;
+  int fd;
+  size_t file_size;
+  size_t bytes_free;
+} memory_allocator_t;
 
 /*
  * Initializes a memory allocator with a specified block size.
  * Parameters:
- * - size_t block_size: Size of each memory block to be managed
+ * - size_t block_size: Size of the first memory block to be managed
  * Returns: Pointer to the initialized memory allocator
  */
 memory_allocator_t *init_memory_allocator(size_t arena_size);
 
+/*
+ * Initializes a memory allocator whose blocks are mapped from a file rather
+ * than allocated in memory, so that it can hold more than the available RAM:
+ * the kernel writes cold pages back to the file and reads them again on
+ * access. The file is created (or truncated) and immediately unlinked, so it
+ * never outlives the allocator.
+ * Parameters:
+ * - char const *path: Path of the file
+ * - size_t block_size: Size of the first memory block to be managed (rounded
+ *     up to a multiple of the page size)
+ * Returns: Pointer to the initialized memory allocator, or NULL if the file
+ *   cannot be created
+ */
+memory_allocator_t *init_memory_allocator_mapped(char const *path,
+                                                 size_t block_size);
+
 /*
  * Requests memory from the allocator.
  * Parameters:
  * - memory_allocator_t *allocator: Pointer to the memory allocator
- * - size_t size: Size (in bytes) of memory to allocate
- * Returns: Pointer to the allocated memory
+ * - size_t size: Size (in bytes) of memory to allocate, rounded up to a
+ *     multiple of MEMORY_ALIGNMENT
+ * Returns: Handle to the allocated memory (see memory_deref)
+ */
+memory_ref_t allocate(memory_allocator_t *allocator, size_t size);
+
+/*
+ * Gives memory back to the allocator, to be reused by later allocations of the
+ * same size. It must not be accessed anymore.
+ * Parameters:
+ * - memory_allocator_t *allocator: Pointer to the memory allocator
+ * - memory_ref_t ref: Handle returned by allocate
+ * - size_t size: Size passed to allocate
+ */
+void release(memory_allocator_t *allocator, memory_ref_t ref, size_t size);
+
+/*
+ * Gives back memory that has just been made unreachable: it is released as
+ * soon as no reader can still be accessing it, i.e. immediately unless a
+ * reclamation domain is attached to the allocator (see ebr.h).
+ * Parameters: as for release
+ */
+void retire(memory_allocator_t *allocator, memory_ref_t ref, size_t size);
+
+/*
+ * Converts a handle returned by allocate into a pointer.
+ * Parameters:
+ * - memory_allocator_t const *allocator: Pointer to the memory allocator
+ * - memory_ref_t ref: Handle to convert (not MEMORY_NULL_REF)
+ * Returns: Pointer to the memory referred to by `ref`
+ */
+static inline void *memory_deref(memory_allocator_t const *allocator,
+                                 memory_ref_t ref) {
+  return allocator->blocks[ref >> MEMORY_OFFSET_BITS] +
+         (size_t)(ref & ((1u << MEMORY_OFFSET_BITS) - 1)) * MEMORY_ALIGNMENT;
+}
+
+/*
+ * Tells the kernel how the memory of the allocator is about to be accessed,
+ * e.g. MEMORY_ADVICE_SEQUENTIAL before a pass over memory laid out in
+ * traversal order (see rax_cluster), so that pages are read ahead and
+ * dropped early. It does nothing for malloc-backed allocators.
+ * Parameters:
+ * - memory_allocator_t const *allocator: Pointer to the memory allocator
+ * - memory_advice_t advice: Expected access pattern
+ */
+void memory_advise(memory_allocator_t const *allocator, memory_advice_t advice);
+
+/*
+ * Fills in the statistics of the allocator.
+ * Parameters:
+ * - memory_allocator_t const *allocator: Pointer to the memory allocator
+ * - memory_stats_t *stats: Statistics to fill in
  */
-void *allocate(memory_allocator_t *allocator, size_t size);
+void memory_get_stats(memory_allocator_t const *allocator,
+                      memory_stats_t *stats);
 
 /*
  * Deallocates all memory allocated by the allocator and frees the allocator
@@ -2,82 +2,494 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 
+#include "constants.h"
 #include "memory_allocator.h"
 #include "rax.h"
 #include "utils.h"
 
-static rax_t *rax_alloc_node(memory_allocator_t *allocator, size_t k);
+static memory_ref_t rax_alloc_node(memory_allocator_t *allocator, size_t k);
+static memory_ref_t rax_alloc_bucket(memory_allocator_t *allocator,
+                                     size_t size, size_t suffix_size);
 
-static bool rax_search_aux(rax_t const *root, char const *str, size_t curr_idx);
+static bool rax_search_aux(memory_allocator_t const *allocator,
+                           rax_t const *root, char const *str, size_t curr_idx);
 /*
  * Searches for a node in a list of siblings whose substr starts with the given
  * character. Parameters:
- * - rax_t *child: Pointer to the first node, all of its siblings will be
+ * - memory_allocator_t const *allocator: Allocator holding the trie
+ * - memory_ref_t child: Handle of the first node, all of its siblings will be
  * considered
  * - char to_find: Character that node->substr[0] has to match
- * Returns: Pointer to the found node, or NULL if no such node exists
+ * Returns: Handle of the found node, or MEMORY_NULL_REF if no such node exists
  */
-static rax_t *rax_search_child(rax_t *child, char to_find);
+static memory_ref_t rax_search_child(memory_allocator_t const *allocator,
+                                     memory_ref_t child, char to_find);
 
 static void rax_insert_aux(memory_allocator_t *allocator, rax_t *root,
-                           char const *str, size_t curr_idx, size_t str_size,
-                           size_t game);
-static rax_t *rax_insert_child(rax_t *child, rax_t *to_ins);
+                           _Atomic memory_ref_t *link, char const *str,
+                           size_t curr_idx, size_t str_size, size_t game);
+/*
+ * Searches for the position of a character in a list of siblings (sorted by
+ * their first character).
+ * Parameters:
+ * - memory_allocator_t const *allocator: Allocator holding the trie
+ * - _Atomic memory_ref_t *link: Handle of the first node of the list
+ * - char to_find: Character to find
+ * Returns: The first handle of the list (either `link` or the sibling handle
+ *   of a node) that is MEMORY_NULL_REF or refers to a node whose substr[0] is
+ *   not smaller than `to_find`
+ */
+static _Atomic memory_ref_t *rax_find_link(memory_allocator_t const *allocator,
+                                           _Atomic memory_ref_t *link,
+                                           char to_find);
+/*
+ * Replaces `root` (referred to by `link`) with a node labeled with the first
+ * substr_idx characters of its label, whose children are the rest of its
+ * label and the rest of `str`. The new nodes are built off to the side and
+ * published at once, then `root` is retired.
+ */
+static void rax_split(memory_allocator_t *allocator, rax_t *root,
+                      _Atomic memory_ref_t *link, char const *str,
+                      size_t curr_idx, size_t substr_idx, size_t str_size,
+                      size_t game, size_t old_filter);
 
-static void rax_print_aux(rax_t const *root, char *str, size_t curr_idx,
-                          size_t game);
+/*
+ * Searches for a suffix in a bucket.
+ * Parameters:
+ * - rax_t const *bucket: Pointer to the bucket
+ * - char const *suffix: Suffix to find (at least as long as the bucket ones)
+ * - size_t *pos: Set to the index of the first suffix not smaller than
+ *     `suffix`, i.e. where it is or should be inserted
+ * Returns: true if the suffix is in the bucket, false otherwise
+ */
+static bool rax_bucket_find(rax_t const *bucket, char const *suffix,
+                            size_t *pos);
+/*
+ * Inserts a suffix in the bucket child of `parent`, by replacing the bucket
+ * with a copy including the suffix.
+ * Returns: false if the bucket would exceed its maximum size, in which case
+ *   nothing is inserted
+ */
+static bool rax_bucket_insert(memory_allocator_t *allocator, rax_t *parent,
+                              char const *suffix, size_t game);
+/*
+ * Bursts a bucket into a list of regular nodes, one per distinct first
+ * character, each of them with a smaller bucket as its child when more than
+ * one suffix shares that character.
+ * Returns: Handle of the first node of the list
+ */
+static memory_ref_t rax_burst(memory_allocator_t *allocator,
+                              memory_ref_t bucket_ref);
+
+static size_t rax_print_aux(memory_allocator_t const *allocator,
+                            rax_t const *root, char *str, size_t curr_idx,
+                            size_t game);
+
+static void rax_clear_filters(memory_allocator_t const *allocator, rax_t *root);
+/*
+ * Copies a node and its subtree, or a list of siblings and their subtrees, in
+ * the order described in rax_cluster.
+ * Returns: Handle of the (first) copy, in `to`
+ */
+static memory_ref_t rax_cluster_node(memory_allocator_t const *from,
+                                     rax_t const *node, memory_allocator_t *to);
+static memory_ref_t rax_cluster_list(memory_allocator_t const *from,
+                                     memory_ref_t ref, memory_allocator_t *to);
+static size_t rax_node_size(rax_t const *node);
+/*
+ * Counts (if pruned->nodes is NULL) or records the roots of the pruned
+ * subtrees and the partly pruned buckets under a surviving node (see
+ * rax_pruned_save).
+ */
+static void rax_pruned_aux(memory_allocator_t const *allocator,
+                           rax_t const *root, size_t game,
+                           rax_pruned_t *pruned);
+/*
+ * Range of consecutive children of the root formatted by a thread of
+ * rax_print_parallel.
+ * Members:
+ * - memory_allocator_t const *allocator: Allocator holding the trie
+ * - memory_ref_t first:  Handle of the first child of the range
+ * - size_t size:         Number of children in the range
+ * - size_t k:            Length of the strings
+ * - size_t game:         Game whose pruned strings are skipped
+ * - char *out:           Formatted strings (`out_size` bytes used out of
+ *     `out_capacity`)
+ * - size_t printed:      Number of strings formatted
+ */
+typedef struct rax_print_range_t {
+  memory_allocator_t const *allocator;
+  memory_ref_t first;
+  size_t size;
+  size_t k;
+  size_t game;
+  char *out;
+  size_t out_size;
+  size_t out_capacity;
+  size_t printed;
+} rax_print_range_t;
+/*
+ * Formats the strings of a range, one per line (thrd_start_t).
+ */
+static int rax_print_range(void *arg);
+/*
+ * Same as rax_print_aux, but appends the strings to the buffer of a range.
+ */
+static void rax_format_aux(rax_print_range_t *range, rax_t const *root,
+                           char *str, size_t curr_idx);
+/*
+ * Appends a string of length range->k and a newline to the buffer of a range.
+ */
+static void rax_format_string(rax_print_range_t *range, char const *str);
+/*
+ * Yields the strings of the subtree rooted at `root` (see rax_iter_next).
+ * Parameters:
+ * - size_t pos: Position of the label of root in the strings
+ * - bool bounded: Whether the path to root matches the cursor, so that only
+ *     the strings greater than the cursor are to be yielded
+ * - size_t *count: Number of strings yielded so far
+ * Returns: true if the iteration has to stop (page full or past the prefix)
+ */
+static bool rax_iter_aux(memory_allocator_t const *allocator,
+                         rax_t const *root, rax_iter_t *it, size_t pos,
+                         bool bounded, char *words, size_t n, size_t *count);
+/*
+ * Compares a segment of a string (at position pos) with the prefix and, if
+ * `*bounded`, with the cursor of an iterator; `*bounded` is cleared once the
+ * segment is greater than the cursor.
+ * Returns: -1 if the strings with the segment precede the prefix or the
+ *   cursor, 1 if they follow the prefix, 0 otherwise
+ */
+static int rax_iter_compare(rax_iter_t const *it, char const *segment,
+                            size_t pos, size_t size, bool *bounded);
+/*
+ * Appends the current path of an iterator to the page, and makes it the
+ * cursor.
+ * Returns: true if the page is full
+ */
+static bool rax_iter_yield(rax_iter_t *it, char *words, size_t n,
+                           size_t *count);
+/*
+ * Adds a node and its subtree to the statistics of a trie (see rax_stats).
+ * Parameters:
+ * - size_t depth: Depth of the node
+ * - bool pruned: Whether an ancestor of the node is pruned
+ */
+static void rax_stats_aux(memory_allocator_t const *allocator,
+                          rax_t const *root, size_t depth, size_t game,
+                          bool pruned, rax_stats_t *stats);
+/*
+ * Prints the non-zero entries of a histogram on a line, as `index:count`
+ * (`index+:count` for the last entry if it also counts larger values).
+ */
+static void rax_stats_print_histogram(FILE *out, char const *name,
+                                      size_t const *histogram, size_t size,
+                                      bool capped);
+
+/*
+ * Makes the node `ref` reachable through `link`: readers loading the handle
+ * see everything written to the node before.
+ */
+static inline void rax_publish(_Atomic memory_ref_t *link, memory_ref_t ref) {
+  atomic_store_explicit(link, ref, memory_order_release);
+}
 
 rax_t *rax_alloc(memory_allocator_t *allocator) {
-  return rax_alloc_node(allocator, 0);
+  return rax_node(allocator, rax_alloc_node(allocator, 0));
 }
 
-bool rax_search(rax_t const *root, char const *str) {
-  return rax_search_aux(root, str, 0);
+bool rax_search(memory_allocator_t const *allocator, rax_t const *root,
+                char const *str) {
+  return rax_search_aux(allocator, root, str, 0);
 }
 
 void rax_insert(memory_allocator_t *allocator, rax_t *root, char const *str,
                 size_t str_size, size_t game) {
-  rax_insert_aux(allocator, root, str, 0, str_size, game);
+  rax_insert_aux(allocator, root, NULL, str, 0, str_size, game);
+}
+
+size_t rax_print(memory_allocator_t const *allocator, rax_t const *root,
+                 char *str, size_t game) {
+  return rax_print_aux(allocator, root, str, 0, game);
 }
 
-void rax_print(rax_t const *root, char *str, size_t game) {
-  rax_print_aux(root, str, 0, game);
+size_t rax_print_parallel(memory_allocator_t const *allocator,
+                          rax_t const *root, size_t k, size_t game,
+                          size_t const *counts, size_t threads) {
+  char str[k + 1];
+  memory_ref_t child = root->child;
+  size_t children = 0;
+
+  if (child != MEMORY_NULL_REF && !rax_is_bucket(rax_node(allocator, child))) {
+    for (memory_ref_t tmp = child; tmp != MEMORY_NULL_REF;
+         tmp = rax_node(allocator, tmp)->sibling)
+      children++;
+  }
+
+  if (threads > children)
+    threads = children;
+  if (threads <= 1 || root->filter == game)
+    return rax_print(allocator, root, str, game);
+
+  // count the strings under each child, unless update_filter already did
+  size_t weights[children], total = 0;
+  memory_ref_t refs[children];
+  for (size_t i = 0; i < children; i++) {
+    rax_t const *node = rax_node(allocator, child);
+    refs[i] = child;
+    weights[i] = counts != NULL && children <= ALPHABET_SIZE
+                     ? counts[i]
+                     : rax_size(allocator, node, game);
+    total += weights[i];
+    child = node->sibling;
+  }
+
+  // cut the children into ranges holding about total / threads strings each
+  rax_print_range_t ranges[threads];
+  size_t range_count = 0, first = 0, sum = 0, range_sum = 0;
+  for (size_t i = 0; i < children; i++) {
+    sum += weights[i];
+    range_sum += weights[i];
+    if (i + 1 == children ||
+        (range_count + 1 < threads &&
+         sum * threads >= total * (range_count + 1))) {
+      rax_print_range_t *range = &ranges[range_count++];
+      range->allocator = allocator;
+      range->first = refs[first];
+      range->size = i + 1 - first;
+      range->k = k;
+      range->game = game;
+      // the buffer grows if strings were inserted since counts was filled
+      range->out_capacity = range_sum * (k + 1);
+      range->out = (char *)malloc(range->out_capacity);
+      range->out_size = 0;
+      range->printed = 0;
+      first = i + 1;
+      range_sum = 0;
+    }
+  }
+
+  // the first range is formatted by the calling thread
+  thrd_t workers[range_count];
+  bool started[range_count];
+  for (size_t i = 1; i < range_count; i++)
+    started[i] =
+        thrd_create(&workers[i], rax_print_range, &ranges[i]) == thrd_success;
+  rax_print_range(&ranges[0]);
+
+  // write the buffers in order, each as soon as it is ready
+  size_t printed = 0;
+  for (size_t i = 0; i < range_count; i++) {
+    if (i > 0) {
+      if (started[i])
+        thrd_join(workers[i], NULL);
+      else
+        rax_print_range(&ranges[i]);
+    }
+    fwrite(ranges[i].out, 1, ranges[i].out_size, stdout);
+    printed += ranges[i].printed;
+    free(ranges[i].out);
+  }
+
+  return printed;
 }
 
-size_t rax_size(rax_t const *root, size_t game) {
+size_t rax_size(memory_allocator_t const *allocator, rax_t const *root,
+                size_t game) {
   if (root->filter == game)
     return 0; // node and subtree filtered out
 
   size_t ans = 0;
-  rax_t *tmp;
+  memory_ref_t tmp;
 
   // Recurring on first child and siblings
   tmp = root->child;
-  if (tmp == NULL)
+  if (tmp == MEMORY_NULL_REF)
     return 1;
-  while (tmp != NULL) {
-    ans += rax_size(tmp, game);
-    tmp = tmp->sibling;
+  if (rax_is_bucket(rax_node(allocator, tmp))) {
+    rax_t const *bucket = rax_node(allocator, tmp);
+    for (size_t i = 0; i < rax_bucket_size(bucket); i++) {
+      if (!rax_bucket_is_pruned(bucket, i, game))
+        ans++;
+    }
+    return ans;
+  }
+  while (tmp != MEMORY_NULL_REF) {
+    rax_t const *node = rax_node(allocator, tmp);
+    ans += rax_size(allocator, node, game);
+    tmp = node->sibling;
   }
 
   return ans;
 }
 
-rax_t *rax_alloc_node(memory_allocator_t *allocator, size_t k) {
-  rax_t *new_node = (rax_t *)allocate(allocator, sizeof(rax_t) + k + 1);
+size_t rax_next_epoch(memory_allocator_t const *allocator, rax_t *root,
+                      size_t game) {
+  if (game < RAX_MAX_EPOCH)
+    return game + 1;
+
+  // out of epochs: a stale filter equal to a reused index would prune nodes
+  // of the new game, so all of them are cleared
+  rax_clear_filters(allocator, root);
+  return 1;
+}
+
+rax_t *rax_cluster(memory_allocator_t const *from, rax_t const *root,
+                   memory_allocator_t *to) {
+  return rax_node(to, rax_cluster_node(from, root, to));
+}
+
+rax_pruned_t *rax_pruned_save(memory_allocator_t const *allocator,
+                              rax_t const *root, size_t game) {
+  rax_pruned_t counts = {root->filter == game, 0, 0, NULL};
+
+  if (!counts.root)
+    rax_pruned_aux(allocator, root, game, &counts);
+
+  rax_pruned_t *pruned = (rax_pruned_t *)malloc(rax_pruned_bytes(&counts));
+  pruned->root = counts.root;
+  pruned->nodes_size = pruned->buckets_size = 0;
+  pruned->nodes = (memory_ref_t *)(pruned->buckets + counts.buckets_size);
+  if (!pruned->root)
+    rax_pruned_aux(allocator, root, game, pruned);
+
+  return pruned;
+}
+
+void rax_pruned_apply(memory_allocator_t const *allocator, rax_t *root,
+                      rax_pruned_t const *pruned, size_t game) {
+  if (pruned->root)
+    rax_set_filter(root, game);
 
-  new_node->filter = 0;
-  new_node->sibling = NULL;
-  new_node->child = NULL;
+  for (size_t i = 0; i < pruned->nodes_size; i++)
+    rax_set_filter(rax_node(allocator, pruned->nodes[i]), game);
+
+  for (size_t i = 0; i < pruned->buckets_size; i++) {
+    rax_t *bucket = rax_node(allocator, pruned->buckets[i].bucket);
+
+    // the mask of a bucket is only meaningful while its filter is the game
+    uint64_t mask = pruned->buckets[i].pruned;
+    if (bucket->filter == game)
+      mask |= rax_bucket_pruned(bucket);
+    rax_bucket_set_pruned(bucket, mask);
+    rax_set_filter(bucket, game);
+  }
+}
+
+rax_iter_t *rax_iter_alloc(size_t k) {
+  rax_iter_t *it = (rax_iter_t *)malloc(sizeof(rax_iter_t) + 3 * (k + 1));
+
+  it->k = k;
+  it->prefix = it->buffer;
+  it->cursor = it->buffer + (k + 1);
+  it->str = it->buffer + 2 * (k + 1);
+  rax_iter_reset(it, 0, "");
+  return it;
+}
+
+void rax_iter_reset(rax_iter_t *it, size_t game, char const *prefix) {
+  it->game = game;
+  it->prefix_size = strlen(prefix) < it->k ? strlen(prefix) : it->k;
+  memcpy(it->prefix, prefix, it->prefix_size);
+  it->has_cursor = false;
+  it->done = false;
+}
+
+void rax_iter_seek(rax_iter_t *it, char const *cursor) {
+  memcpy(it->cursor, cursor, it->k);
+  it->has_cursor = true;
+  it->done = false;
+}
+
+size_t rax_iter_next(memory_allocator_t const *allocator, rax_t const *root,
+                     rax_iter_t *it, char *words, size_t n) {
+  size_t count = 0;
+
+  if (it->done || n == 0)
+    return 0;
+
+  if (!rax_iter_aux(allocator, root, it, 0, it->has_cursor, words, n, &count))
+    it->done = true; // the whole trie has been visited
+
+  return count;
+}
+
+void rax_iter_dealloc(rax_iter_t *it) { free(it); }
+
+void rax_stats(memory_allocator_t const *allocator, rax_t const *root,
+               size_t game, rax_stats_t *stats) {
+  memset(stats, 0, sizeof(rax_stats_t));
+  rax_stats_aux(allocator, root, 0, game, false, stats);
+}
+
+void rax_stats_print(FILE *out, rax_stats_t const *stats) {
+  size_t max_depth = 0;
+  for (size_t d = 0; d < RAX_STATS_MAX_DEPTH; d++) {
+    if (stats->depth_nodes[d] != 0 || stats->leaf_depth[d] != 0)
+      max_depth = d;
+  }
+
+  fprintf(out, "trie: %zu strings, %zu nodes, %zu buckets\n", stats->strings,
+          stats->nodes, stats->buckets);
+  fprintf(out,
+          "trie bytes: %zu headers, %zu labels, %zu bucket suffixes, %zu "
+          "padding\n",
+          stats->header_bytes, stats->label_bytes, stats->suffix_bytes,
+          stats->padding_bytes);
+  rax_stats_print_histogram(out, "label length", stats->label_length,
+                            RAX_STATS_MAX_LABEL + 1, true);
+  rax_stats_print_histogram(out, "bucket size", stats->bucket_size,
+                            RAX_BUCKET_MAX_SIZE + 1, false);
+  rax_stats_print_histogram(out, "fan-out", stats->fanout,
+                            RAX_STATS_MAX_FANOUT + 1, true);
+
+  fprintf(out, "depth %10s %10s %10s %10s %10s\n", "nodes", "children",
+          "fan-out", "leaves", "pruned");
+  for (size_t d = 0; d <= max_depth; d++) {
+    fprintf(out, "%5zu %10zu %10zu %10.2f %10zu %10zu\n", d,
+            stats->depth_nodes[d], stats->depth_children[d],
+            stats->depth_nodes[d] == 0
+                ? 0.0
+                : (double)stats->depth_children[d] / stats->depth_nodes[d],
+            stats->leaf_depth[d], stats->depth_pruned[d]);
+  }
+}
+
+memory_ref_t rax_alloc_node(memory_allocator_t *allocator, size_t k) {
+  memory_ref_t new_ref = allocate(allocator, RAX_HEADER_SIZE + k + 1);
+  rax_t *new_node = rax_node(allocator, new_ref);
+
+  atomic_init(&new_node->filter, 0);
+  atomic_init(&new_node->sibling, MEMORY_NULL_REF);
+  atomic_init(&new_node->child, MEMORY_NULL_REF);
   new_node->substr[k] = '\0';
 
-  return new_node;
+  return new_ref;
+}
+
+memory_ref_t rax_alloc_bucket(memory_allocator_t *allocator, size_t size,
+                              size_t suffix_size) {
+  memory_ref_t new_ref = allocate(
+      allocator, RAX_HEADER_SIZE + RAX_BUCKET_HEADER_SIZE + size * suffix_size);
+  rax_t *new_bucket = rax_node(allocator, new_ref);
+
+  atomic_init(&new_bucket->filter, 0);
+  atomic_init(&new_bucket->sibling, MEMORY_NULL_REF);
+  atomic_init(&new_bucket->child, MEMORY_NULL_REF);
+  new_bucket->substr[0] = RAX_BUCKET_MARK;
+  new_bucket->substr[1] = (char)size;
+  new_bucket->substr[2] = (char)suffix_size;
+  rax_bucket_set_pruned(new_bucket, 0);
+
+  return new_ref;
 }
 
-bool rax_search_aux(rax_t const *root, char const *str, size_t curr_idx) {
+bool rax_search_aux(memory_allocator_t const *allocator, rax_t const *root,
+                    char const *str, size_t curr_idx) {
   size_t substr_idx, new_idx;
-  rax_t *good_child;
+  memory_ref_t child, good_child;
 
   // if str[curr_idx:curr_idx + len(root->substr)] != root->substr, return false
   for (substr_idx = 0; root->substr[substr_idx] != '\0'; substr_idx++) {
@@ -90,62 +502,56 @@ bool rax_search_aux(rax_t const *root, char const *str, size_t curr_idx) {
   if (str[new_idx] == '\0')
     return true;
 
+  // the handle is read once: a concurrent insertion may replace the child
+  child = root->child;
+
+  // the rest of the string can only be one of the suffixes of a bucket
+  if (child != MEMORY_NULL_REF && rax_is_bucket(rax_node(allocator, child))) {
+    size_t pos;
+    return rax_bucket_find(rax_node(allocator, child), str + new_idx, &pos);
+  }
+
   // the string is only partially matched, so we need to search for the next
   // node to continue within the linked list of children (following the sibling
-  // pointers)
-  good_child = rax_search_child(root->child, str[new_idx]);
-  if (good_child == NULL)
+  // handles)
+  good_child = rax_search_child(allocator, child, str[new_idx]);
+  if (good_child == MEMORY_NULL_REF)
     return false;
-  return rax_search_aux(good_child, str, new_idx);
+  return rax_search_aux(allocator, rax_node(allocator, good_child), str,
+                        new_idx);
 }
 
-rax_t *rax_search_child(rax_t *child, char to_find) {
-  while (child != NULL) {
-    if (child->substr[0] == to_find)
+memory_ref_t rax_search_child(memory_allocator_t const *allocator,
+                              memory_ref_t child, char to_find) {
+  while (child != MEMORY_NULL_REF) {
+    rax_t const *node = rax_node(allocator, child);
+    if (node->substr[0] == to_find)
       return child;
 
-    child = child->sibling;
+    child = node->sibling;
   }
 
   // no node found
-  return NULL;
+  return MEMORY_NULL_REF;
 }
 
-void rax_insert_aux(memory_allocator_t *allocator, rax_t *root, char const *str,
+void rax_insert_aux(memory_allocator_t *allocator, rax_t *root,
+                    _Atomic memory_ref_t *link, char const *str,
                     size_t curr_idx, size_t str_size, size_t game) {
   size_t substr_idx, new_idx, old_filter;
-  rax_t *new_node, *new_node_son, *old_child, *child_find;
+  _Atomic memory_ref_t *child_link;
 
   old_filter = root->filter;
   if (game == 0)
-    root->filter = 0;
+    rax_set_filter(root, 0);
 
   size_t substr_size = strlen(root->substr);
 
   for (substr_idx = 0; root->substr[substr_idx] != '\0'; substr_idx++) {
     if (root->substr[substr_idx] != str[curr_idx + substr_idx]) {
-      // allocating the new nodes
-      new_node = rax_alloc_node(allocator, str_size - substr_idx - curr_idx);
-      new_node_son = rax_alloc_node(allocator, substr_size - substr_idx);
-
-      // copying the correct substrings into the nodes
-      substring_copy(new_node->substr, str, substr_idx + curr_idx, str_size);
-      substring_copy(new_node_son->substr, root->substr, substr_idx, substr_size);
-      root->substr[substr_idx] = '\0';
-
-      // saving the children of root
-      old_child = root->child;
-      root->child = NULL;
-
-      // set the filters
-      new_node->filter = game;
-      new_node_son->filter = old_filter;
-
-      // setting the children of root
-      root->child = rax_insert_child(root->child, new_node);
-      root->child = rax_insert_child(root->child, new_node_son);
-      new_node_son->child = old_child;
-
+      // the label of the root of the trie is empty, so here `link` is set
+      rax_split(allocator, root, link, str, curr_idx, substr_idx, str_size,
+                game, old_filter);
       return;
     }
   }
@@ -155,47 +561,126 @@ void rax_insert_aux(memory_allocator_t *allocator, rax_t *root, char const *str,
   if (new_idx == str_size)
     return; // the string is already present in the trie
 
-  child_find = rax_search_child(root->child, str[new_idx]);
-  if (child_find == NULL) {
+  if (root->child != MEMORY_NULL_REF &&
+      rax_is_bucket(rax_node(allocator, root->child))) {
+    if (rax_bucket_insert(allocator, root, str + new_idx, game))
+      return;
+
+    // the bucket is full: burst it and insert among the resulting nodes
+    memory_ref_t bucket_ref = root->child;
+    rax_publish(&root->child, rax_burst(allocator, bucket_ref));
+    retire(allocator, bucket_ref,
+           rax_node_size(rax_node(allocator, bucket_ref)));
+  }
+
+  child_link = rax_find_link(allocator, &root->child, str[new_idx]);
+  if (*child_link == MEMORY_NULL_REF ||
+      rax_node(allocator, *child_link)->substr[0] != str[new_idx]) {
     // create the new node and fill it with its substring
-    new_node = rax_alloc_node(allocator, str_size - new_idx);
+    memory_ref_t new_ref = rax_alloc_node(allocator, str_size - new_idx);
+    rax_t *new_node = rax_node(allocator, new_ref);
     substring_copy(new_node->substr, str, new_idx, str_size);
-    new_node->filter = game;
+    rax_set_filter(new_node, game);
 
-    // insert the new node as a child of root
-    root->child = rax_insert_child(root->child, new_node);
+    // link it before the first sibling with a greater first character
+    rax_publish(&new_node->sibling, *child_link);
+    rax_publish(child_link, new_ref);
     return;
   }
 
-  rax_insert_aux(allocator, child_find, str, new_idx, str_size, game);
+  rax_insert_aux(allocator, rax_node(allocator, *child_link), child_link, str,
+                 new_idx, str_size, game);
+}
+
+_Atomic memory_ref_t *rax_find_link(memory_allocator_t const *allocator,
+                                    _Atomic memory_ref_t *link, char to_find) {
+  while (*link != MEMORY_NULL_REF &&
+         rax_node(allocator, *link)->substr[0] < to_find) {
+    link = &rax_node(allocator, *link)->sibling;
+  }
+
+  return link;
 }
 
-rax_t *rax_insert_child(rax_t *child, rax_t *to_ins) {
-  if (child == NULL)
-    return to_ins;
-  char new_val = to_ins->substr[0];
-  rax_t *tmp = child;
+void rax_split(memory_allocator_t *allocator, rax_t *root,
+               _Atomic memory_ref_t *link, char const *str, size_t curr_idx,
+               size_t substr_idx, size_t str_size, size_t game,
+               size_t old_filter) {
+  size_t substr_size = strlen(root->substr);
+  size_t suffix_size = substr_size - substr_idx;
+  memory_ref_t root_ref = *link;
+  char const *old_suffix = root->substr + substr_idx;
+  char const *new_suffix = str + curr_idx + substr_idx;
+
+  // the node replacing root, labeled with the common prefix
+  memory_ref_t prefix_ref = rax_alloc_node(allocator, substr_idx);
+  rax_t *prefix = rax_node(allocator, prefix_ref);
+  memcpy(prefix->substr, root->substr, substr_idx);
+  rax_set_filter(prefix, root->filter);
+  rax_publish(&prefix->sibling, root->sibling);
+
+  if (root->child == MEMORY_NULL_REF &&
+      2 * suffix_size <= RAX_BUCKET_MAX_BYTES) {
+    // root is a leaf: its old suffix and the new one go in a bucket
+    memory_ref_t bucket_ref = rax_alloc_bucket(allocator, 2, suffix_size);
+    rax_t *bucket = rax_node(allocator, bucket_ref);
+    size_t new_pos = new_suffix[0] > old_suffix[0];
 
-  if (new_val > child->substr[0]) {
-    while (tmp->sibling != NULL && new_val > tmp->sibling->substr[0]) {
-      tmp = tmp->sibling;
+    memcpy((char *)rax_bucket_suffix(bucket, new_pos), new_suffix,
+           suffix_size);
+    memcpy((char *)rax_bucket_suffix(bucket, 1 - new_pos), old_suffix,
+           suffix_size);
+
+    // the old suffix keeps the filter of root, the new one gets `game`
+    if (game != 0) {
+      rax_set_filter(bucket, game);
+      rax_bucket_set_pruned(bucket, (uint64_t)1 << new_pos |
+                                        (uint64_t)(old_filter == game)
+                                            << (1 - new_pos));
+    } else if (old_filter != 0) {
+      rax_set_filter(bucket, old_filter);
+      rax_bucket_set_pruned(bucket, (uint64_t)1 << (1 - new_pos));
     }
 
-    to_ins->sibling = tmp->sibling;
-    tmp->sibling = to_ins;
-    return child;
+    rax_publish(&prefix->child, bucket_ref);
   } else {
-    to_ins->sibling = child;
-    return to_ins;
+    // allocating the new nodes
+    memory_ref_t new_ref =
+        rax_alloc_node(allocator, str_size - substr_idx - curr_idx);
+    memory_ref_t new_son_ref = rax_alloc_node(allocator, suffix_size);
+    rax_t *new_node = rax_node(allocator, new_ref);
+    rax_t *new_node_son = rax_node(allocator, new_son_ref);
+
+    // copying the correct substrings into the nodes
+    substring_copy(new_node->substr, str, substr_idx + curr_idx, str_size);
+    substring_copy(new_node_son->substr, root->substr, substr_idx, substr_size);
+
+    // the rest of the label of root keeps its filter and children
+    rax_set_filter(new_node, game);
+    rax_set_filter(new_node_son, old_filter);
+    rax_publish(&new_node_son->child, root->child);
+
+    // setting the children of the prefix, in order
+    if (new_suffix[0] < old_suffix[0]) {
+      rax_publish(&new_node->sibling, new_son_ref);
+      rax_publish(&prefix->child, new_ref);
+    } else {
+      rax_publish(&new_node_son->sibling, new_ref);
+      rax_publish(&prefix->child, new_son_ref);
+    }
   }
+
+  rax_publish(link, prefix_ref);
+  retire(allocator, root_ref, rax_node_size(root));
 }
 
-void rax_print_aux(rax_t const *root, char *str, size_t curr_idx, size_t game) {
+size_t rax_print_aux(memory_allocator_t const *allocator, rax_t const *root,
+                     char *str, size_t curr_idx, size_t game) {
   if (root->filter == game)
-    return;
+    return 0;
 
-  size_t substr_idx, new_idx;
-  rax_t *tmp;
+  size_t substr_idx, new_idx, printed = 0;
+  memory_ref_t tmp;
   for (substr_idx = 0; root->substr[substr_idx] != '\0'; substr_idx++) {
     str[curr_idx + substr_idx] = root->substr[substr_idx];
   }
@@ -203,14 +688,480 @@ void rax_print_aux(rax_t const *root, char *str, size_t curr_idx, size_t game) {
   new_idx = substr_idx + curr_idx;
   tmp = root->child;
 
-  if (tmp == NULL) {
+  if (tmp == MEMORY_NULL_REF) {
     str[new_idx] = '\0';
     printf("%s\n", str);
+    return 1;
+  }
+
+  if (rax_is_bucket(rax_node(allocator, tmp))) {
+    rax_t const *bucket = rax_node(allocator, tmp);
+    size_t suffix_size = rax_bucket_suffix_size(bucket);
+    str[new_idx + suffix_size] = '\0';
+    for (size_t i = 0; i < rax_bucket_size(bucket); i++) {
+      if (rax_bucket_is_pruned(bucket, i, game))
+        continue;
+      memcpy(str + new_idx, rax_bucket_suffix(bucket, i), suffix_size);
+      printf("%s\n", str);
+      printed++;
+    }
+    return printed;
+  }
+
+  while (tmp != MEMORY_NULL_REF) {
+    rax_t const *node = rax_node(allocator, tmp);
+    printed += rax_print_aux(allocator, node, str, new_idx, game);
+    tmp = node->sibling;
+  }
+
+  return printed;
+}
+
+void rax_pruned_aux(memory_allocator_t const *allocator, rax_t const *root,
+                    size_t game, rax_pruned_t *pruned) {
+  memory_ref_t tmp = root->child;
+
+  if (tmp == MEMORY_NULL_REF)
+    return;
+
+  if (rax_is_bucket(rax_node(allocator, tmp))) {
+    rax_t const *bucket = rax_node(allocator, tmp);
+    if (bucket->filter == game && rax_bucket_pruned(bucket) != 0) {
+      if (pruned->nodes != NULL) {
+        pruned->buckets[pruned->buckets_size].bucket = tmp;
+        pruned->buckets[pruned->buckets_size].pruned =
+            rax_bucket_pruned(bucket);
+      }
+      pruned->buckets_size++;
+    }
     return;
   }
 
-  while (tmp != NULL) {
-    rax_print_aux(tmp, str, new_idx, game);
-    tmp = tmp->sibling;
+  while (tmp != MEMORY_NULL_REF) {
+    rax_t const *node = rax_node(allocator, tmp);
+    if (node->filter != game)
+      rax_pruned_aux(allocator, node, game, pruned);
+    else if (pruned->nodes != NULL)
+      pruned->nodes[pruned->nodes_size++] = tmp;
+    else
+      pruned->nodes_size++;
+    tmp = node->sibling;
+  }
+}
+
+int rax_print_range(void *arg) {
+  rax_print_range_t *range = (rax_print_range_t *)arg;
+  char str[range->k + 1];
+  memory_ref_t tmp = range->first;
+
+  for (size_t i = 0; i < range->size; i++) {
+    rax_t const *node = rax_node(range->allocator, tmp);
+    rax_format_aux(range, node, str, 0);
+    tmp = node->sibling;
+  }
+
+  return 0;
+}
+
+void rax_format_aux(rax_print_range_t *range, rax_t const *root, char *str,
+                    size_t curr_idx) {
+  if (root->filter == range->game)
+    return;
+
+  size_t label_size = strlen(root->substr);
+  memcpy(str + curr_idx, root->substr, label_size);
+  curr_idx += label_size;
+
+  memory_ref_t tmp = root->child;
+  if (tmp == MEMORY_NULL_REF) {
+    rax_format_string(range, str);
+    return;
+  }
+
+  if (rax_is_bucket(rax_node(range->allocator, tmp))) {
+    rax_t const *bucket = rax_node(range->allocator, tmp);
+    size_t suffix_size = rax_bucket_suffix_size(bucket);
+    for (size_t i = 0; i < rax_bucket_size(bucket); i++) {
+      if (rax_bucket_is_pruned(bucket, i, range->game))
+        continue;
+      memcpy(str + curr_idx, rax_bucket_suffix(bucket, i), suffix_size);
+      rax_format_string(range, str);
+    }
+    return;
+  }
+
+  while (tmp != MEMORY_NULL_REF) {
+    rax_t const *node = rax_node(range->allocator, tmp);
+    rax_format_aux(range, node, str, curr_idx);
+    tmp = node->sibling;
+  }
+}
+
+void rax_format_string(rax_print_range_t *range, char const *str) {
+  if (range->out_size + range->k + 1 > range->out_capacity) {
+    range->out_capacity = range->out_capacity == 0
+                              ? 1024 * (range->k + 1)
+                              : 2 * range->out_capacity;
+    range->out = (char *)realloc(range->out, range->out_capacity);
+  }
+
+  memcpy(range->out + range->out_size, str, range->k);
+  range->out[range->out_size + range->k] = '\n';
+  range->out_size += range->k + 1;
+  range->printed++;
+}
+
+void rax_clear_filters(memory_allocator_t const *allocator, rax_t *root) {
+  rax_set_filter(root, 0);
+  if (rax_is_bucket(root))
+    rax_bucket_set_pruned(root, 0);
+
+  for (memory_ref_t tmp = root->child; tmp != MEMORY_NULL_REF;) {
+    rax_t *node = rax_node(allocator, tmp);
+    rax_clear_filters(allocator, node);
+    tmp = node->sibling;
+  }
+}
+
+memory_ref_t rax_cluster_node(memory_allocator_t const *from,
+                              rax_t const *node, memory_allocator_t *to) {
+  size_t size = rax_node_size(node);
+  memory_ref_t copy_ref = allocate(to, size);
+  rax_t *copy = rax_node(to, copy_ref);
+
+  // the copy of the node precedes the copies of its descendants
+  memcpy(copy->substr, node->substr, size - RAX_HEADER_SIZE);
+  atomic_init(&copy->filter, node->filter);
+  atomic_init(&copy->sibling, MEMORY_NULL_REF);
+  atomic_init(&copy->child, node->child == MEMORY_NULL_REF
+                                ? MEMORY_NULL_REF
+                                : rax_cluster_list(from, node->child, to));
+
+  return copy_ref;
+}
+
+memory_ref_t rax_cluster_list(memory_allocator_t const *from, memory_ref_t ref,
+                              memory_allocator_t *to) {
+  memory_ref_t head = MEMORY_NULL_REF;
+  rax_t *tail = NULL;
+
+  for (; ref != MEMORY_NULL_REF; ref = rax_node(from, ref)->sibling) {
+    memory_ref_t copy_ref = rax_cluster_node(from, rax_node(from, ref), to);
+
+    if (tail == NULL)
+      head = copy_ref;
+    else
+      atomic_init(&tail->sibling, copy_ref);
+    tail = rax_node(to, copy_ref);
+  }
+
+  return head;
+}
+
+void rax_stats_aux(memory_allocator_t const *allocator, rax_t const *root,
+                   size_t depth, size_t game, bool pruned,
+                   rax_stats_t *stats) {
+  size_t d = depth < RAX_STATS_MAX_DEPTH ? depth : RAX_STATS_MAX_DEPTH - 1;
+  size_t label_size = strlen(root->substr);
+  size_t size = RAX_HEADER_SIZE + label_size + 1;
+
+  stats->nodes++;
+  stats->header_bytes += RAX_HEADER_SIZE;
+  stats->label_bytes += label_size + 1;
+  stats->padding_bytes += (MEMORY_ALIGNMENT - size % MEMORY_ALIGNMENT) %
+                          MEMORY_ALIGNMENT;
+  stats->label_length[label_size < RAX_STATS_MAX_LABEL ? label_size
+                                                       : RAX_STATS_MAX_LABEL]++;
+  stats->depth_nodes[d]++;
+
+  if (!pruned && game != 0 && root->filter == game) {
+    stats->depth_pruned[d]++;
+    pruned = true;
+  }
+
+  memory_ref_t child = root->child;
+  if (child == MEMORY_NULL_REF) {
+    stats->strings++;
+    stats->leaf_depth[d]++;
+    return;
+  }
+
+  size_t children = 0;
+  size_t child_d = d + 1 < RAX_STATS_MAX_DEPTH ? d + 1 : d;
+
+  if (rax_is_bucket(rax_node(allocator, child))) {
+    rax_t const *bucket = rax_node(allocator, child);
+    size_t bucket_size = rax_bucket_size(bucket);
+
+    children = bucket_size;
+    stats->buckets++;
+    stats->header_bytes += RAX_HEADER_SIZE + RAX_BUCKET_HEADER_SIZE;
+    stats->suffix_bytes += rax_node_size(bucket) - RAX_HEADER_SIZE -
+                           RAX_BUCKET_HEADER_SIZE;
+    stats->padding_bytes +=
+        (MEMORY_ALIGNMENT - rax_node_size(bucket) % MEMORY_ALIGNMENT) %
+        MEMORY_ALIGNMENT;
+    stats->bucket_size[bucket_size]++;
+    stats->strings += bucket_size;
+    stats->leaf_depth[child_d] += bucket_size;
+
+    for (size_t i = 0; !pruned && game != 0 && i < bucket_size; i++) {
+      if (rax_bucket_is_pruned(bucket, i, game))
+        stats->depth_pruned[child_d]++;
+    }
+  } else {
+    while (child != MEMORY_NULL_REF) {
+      rax_t const *node = rax_node(allocator, child);
+      rax_stats_aux(allocator, node, depth + 1, game, pruned, stats);
+      children++;
+      child = node->sibling;
+    }
+  }
+
+  stats->depth_children[d] += children;
+  stats->fanout[children < RAX_STATS_MAX_FANOUT ? children
+                                                : RAX_STATS_MAX_FANOUT]++;
+}
+
+void rax_stats_print_histogram(FILE *out, char const *name,
+                               size_t const *histogram, size_t size,
+                               bool capped) {
+  fprintf(out, "%s:", name);
+  for (size_t i = 0; i < size; i++) {
+    if (histogram[i] != 0) {
+      fprintf(out, " %zu%s:%zu", i, capped && i == size - 1 ? "+" : "",
+              histogram[i]);
+    }
   }
+  fprintf(out, "\n");
+}
+
+bool rax_iter_aux(memory_allocator_t const *allocator, rax_t const *root,
+                  rax_iter_t *it, size_t pos, bool bounded, char *words,
+                  size_t n, size_t *count) {
+  if (root->filter == it->game)
+    return false; // node and subtree pruned
+
+  size_t label_size = strlen(root->substr);
+  int cmp = rax_iter_compare(it, root->substr, pos, label_size, &bounded);
+  if (cmp != 0) {
+    it->done = cmp > 0;
+    return it->done;
+  }
+
+  memcpy(it->str + pos, root->substr, label_size);
+  pos += label_size;
+
+  memory_ref_t child = root->child;
+  if (child == MEMORY_NULL_REF) {
+    // a string equal to the cursor has already been yielded
+    return !bounded && rax_iter_yield(it, words, n, count);
+  }
+
+  if (rax_is_bucket(rax_node(allocator, child))) {
+    rax_t const *bucket = rax_node(allocator, child);
+    size_t suffix_size = rax_bucket_suffix_size(bucket);
+
+    for (size_t i = 0; i < rax_bucket_size(bucket); i++) {
+      bool suffix_bounded = bounded;
+      char const *suffix = rax_bucket_suffix(bucket, i);
+
+      if (rax_bucket_is_pruned(bucket, i, it->game))
+        continue;
+      cmp = rax_iter_compare(it, suffix, pos, suffix_size, &suffix_bounded);
+      if (cmp > 0) {
+        it->done = true;
+        return true;
+      }
+      if (cmp < 0 || suffix_bounded)
+        continue;
+
+      memcpy(it->str + pos, suffix, suffix_size);
+      if (rax_iter_yield(it, words, n, count))
+        return true;
+    }
+    return false;
+  }
+
+  while (child != MEMORY_NULL_REF) {
+    rax_t const *node = rax_node(allocator, child);
+    if (rax_iter_aux(allocator, node, it, pos, bounded, words, n, count))
+      return true;
+    child = node->sibling;
+  }
+
+  return false;
+}
+
+int rax_iter_compare(rax_iter_t const *it, char const *segment, size_t pos,
+                     size_t size, bool *bounded) {
+  for (size_t i = 0; i < size && pos + i < it->prefix_size; i++) {
+    if (segment[i] != it->prefix[pos + i])
+      return segment[i] < it->prefix[pos + i] ? -1 : 1;
+  }
+
+  if (*bounded) {
+    int cmp = memcmp(segment, it->cursor + pos, size);
+    if (cmp < 0)
+      return -1;
+    if (cmp > 0)
+      *bounded = false;
+  }
+
+  return 0;
+}
+
+bool rax_iter_yield(rax_iter_t *it, char *words, size_t n, size_t *count) {
+  memcpy(words + *count * (it->k + 1), it->str, it->k);
+  words[*count * (it->k + 1) + it->k] = '\0';
+  memcpy(it->cursor, it->str, it->k);
+  it->has_cursor = true;
+
+  return ++*count == n;
+}
+
+size_t rax_node_size(rax_t const *node) {
+  if (rax_is_bucket(node)) {
+    return RAX_HEADER_SIZE + RAX_BUCKET_HEADER_SIZE +
+           rax_bucket_size(node) * rax_bucket_suffix_size(node);
+  }
+
+  return RAX_HEADER_SIZE + strlen(node->substr) + 1;
+}
+
+bool rax_bucket_find(rax_t const *bucket, char const *suffix, size_t *pos) {
+  size_t size = rax_bucket_size(bucket);
+  size_t suffix_size = rax_bucket_suffix_size(bucket);
+
+  // the suffixes are sorted and few, a linear scan is enough
+  for (*pos = 0; *pos < size; (*pos)++) {
+    int cmp = memcmp(rax_bucket_suffix(bucket, *pos), suffix, suffix_size);
+    if (cmp >= 0)
+      return cmp == 0;
+  }
+
+  return false;
+}
+
+bool rax_bucket_insert(memory_allocator_t *allocator, rax_t *parent,
+                       char const *suffix, size_t game) {
+  memory_ref_t bucket_ref = parent->child;
+  rax_t const *bucket = rax_node(allocator, bucket_ref);
+  size_t size = rax_bucket_size(bucket);
+  size_t suffix_size = rax_bucket_suffix_size(bucket);
+  uint64_t pruned = rax_bucket_pruned(bucket);
+  size_t filter = bucket->filter;
+  size_t new_size, pos;
+
+  if (rax_bucket_find(bucket, suffix, &pos)) {
+    // the string is already present in the trie, only its bit may change
+    if (game != 0 || !((pruned >> pos) & 1))
+      return true;
+
+    new_size = size;
+    pruned &= ~((uint64_t)1 << pos);
+  } else {
+    if (size + 1 > RAX_BUCKET_MAX_SIZE ||
+        (size + 1) * suffix_size > RAX_BUCKET_MAX_BYTES)
+      return false;
+
+    new_size = size + 1;
+    pruned = (pruned & rax_bucket_low_bits(pos)) |
+             (pruned & ~rax_bucket_low_bits(pos)) << 1;
+
+    // the new suffix is filtered out for `game` (if not zero); the bits of
+    // the others are stale if they refer to another game
+    if (game != 0) {
+      if (filter != game) {
+        filter = game;
+        pruned = 0;
+      }
+      pruned |= (uint64_t)1 << pos;
+    }
+  }
+
+  // readers may be scanning the bucket: build a copy with the change and
+  // swap it in
+  memory_ref_t copy_ref = rax_alloc_bucket(allocator, new_size, suffix_size);
+  rax_t *copy = rax_node(allocator, copy_ref);
+  char *to = copy->substr + RAX_BUCKET_HEADER_SIZE;
+  char const *from = bucket->substr + RAX_BUCKET_HEADER_SIZE;
+
+  if (new_size == size) {
+    memcpy(to, from, size * suffix_size);
+  } else {
+    memcpy(to, from, pos * suffix_size);
+    memcpy(to + pos * suffix_size, suffix, suffix_size);
+    memcpy(to + (pos + 1) * suffix_size, from + pos * suffix_size,
+           (size - pos) * suffix_size);
+  }
+  rax_set_filter(copy, filter);
+  rax_bucket_set_pruned(copy, pruned);
+
+  rax_publish(&parent->child, copy_ref);
+  retire(allocator, bucket_ref, rax_node_size(bucket));
+
+  return true;
+}
+
+memory_ref_t rax_burst(memory_allocator_t *allocator, memory_ref_t bucket_ref) {
+  rax_t const *bucket = rax_node(allocator, bucket_ref);
+  size_t size = rax_bucket_size(bucket);
+  size_t suffix_size = rax_bucket_suffix_size(bucket);
+  uint64_t pruned = rax_bucket_pruned(bucket);
+  memory_ref_t head = MEMORY_NULL_REF;
+  rax_t *tail = NULL;
+
+  for (size_t i = 0, j; i < size; i = j) {
+    char const *first = rax_bucket_suffix(bucket, i);
+    size_t prefix_size;
+
+    // suffixes [i, j) start with the same character, and share their first
+    // prefix_size characters (the first and last one are enough to tell)
+    for (j = i + 1; j < size && rax_bucket_suffix(bucket, j)[0] == first[0];
+         j++)
+      ;
+    char const *last = rax_bucket_suffix(bucket, j - 1);
+    if (j - i == 1) {
+      prefix_size = suffix_size;
+    } else {
+      for (prefix_size = 1; first[prefix_size] == last[prefix_size];
+           prefix_size++)
+        ;
+    }
+
+    memory_ref_t new_ref = rax_alloc_node(allocator, prefix_size);
+    rax_t *new_node = rax_node(allocator, new_ref);
+    memcpy(new_node->substr, first, prefix_size);
+
+    // the node is filtered out for the game of the bucket if all of its
+    // suffixes are
+    uint64_t group = rax_bucket_low_bits(j - i) << i;
+    if ((pruned & group) == group)
+      rax_set_filter(new_node, bucket->filter);
+
+    if (j - i > 1) {
+      size_t child_suffix_size = suffix_size - prefix_size;
+      memory_ref_t child_ref =
+          rax_alloc_bucket(allocator, j - i, child_suffix_size);
+      rax_t *child = rax_node(allocator, child_ref);
+
+      for (size_t l = i; l < j; l++) {
+        memcpy((char *)rax_bucket_suffix(child, l - i),
+               rax_bucket_suffix(bucket, l) + prefix_size, child_suffix_size);
+      }
+      rax_set_filter(child, bucket->filter);
+      rax_bucket_set_pruned(child, (pruned & group) >> i);
+      rax_publish(&new_node->child, child_ref);
+    }
+
+    // the suffixes are sorted, so the nodes are created in order
+    if (tail == NULL)
+      head = new_ref;
+    else
+      rax_publish(&tail->sibling, new_ref);
+    tail = new_node;
+  }
+
+  return head;
 }
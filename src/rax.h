@@ -2,27 +2,134 @@
 #define RAX_H
 
 #include "memory_allocator.h"
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+/*
+ * Filters store the game index as a 16-bit epoch: game indices passed to the
+ * functions below must be in [1, RAX_MAX_EPOCH] (zero meaning "no game"), see
+ * rax_next_epoch.
+ */
+#ifndef RAX_MAX_EPOCH
+#define RAX_MAX_EPOCH UINT16_MAX
+#endif
+
+typedef uint16_t rax_epoch_t;
 
 /*
  * Radix trie node structure.
  * Members:
- * - size_t filter: Keeps track of the non-ammissible paths down the trie for
- *     game with index `filter` (game indices are 1-based). Specifically, the
- *     the filtered out paths correspond to the strings that are excluded by
- *     the guess so far of game `filter` and their corresponding feedbacks.
- * - rax_t *sibling: Pointer to the next sibling node
- * - rax_t *child:   Pointer to the first child node
+ * - memory_ref_t child:   Handle of the first child node
+ * - memory_ref_t sibling: Handle of the next sibling node
+ * - rax_epoch_t filter: Keeps track of the non-ammissible paths down the trie
+ *     for game with index `filter` (game indices are 1-based). Specifically,
+ *     the the filtered out paths correspond to the strings that are excluded
+ *     by the guess so far of game `filter` and their corresponding feedbacks.
  * - char substr[]:   String substring store in-place (null-terminated)
+ *
+ * Nodes live in a memory_allocator_t and refer to each other by 32-bit
+ * handles (MEMORY_NULL_REF if there is no child or sibling), so the header
+ * takes RAX_HEADER_SIZE = 10 bytes.
+ *
+ * Handles and filters are atomic so that readers can traverse the trie while
+ * a writer inserts into it (see ebr.h): once a node is reachable, its label
+ * (and the suffixes of a bucket) never change, and insertions only publish new
+ * nodes by storing a single handle with release semantics.
  */
 typedef struct rax_t {
-  size_t filter;
-  struct rax_t *child;
-  struct rax_t *sibling;
+  _Atomic memory_ref_t child;
+  _Atomic memory_ref_t sibling;
+  _Atomic rax_epoch_t filter;
   char substr[];
 } rax_t;
 
+#define RAX_HEADER_SIZE offsetof(rax_t, substr)
+
+/*
+ * Converts the handle of a node into a pointer.
+ */
+static inline rax_t *rax_node(memory_allocator_t const *allocator,
+                              memory_ref_t ref) {
+  return (rax_t *)memory_deref(allocator, ref);
+}
+
+/*
+ * Sets the filter of a node. Filters are only hints about which subtrees the
+ * current game excludes, so no ordering with other memory accesses is needed.
+ */
+static inline void rax_set_filter(rax_t *node, size_t game) {
+  atomic_store_explicit(&node->filter, (rax_epoch_t)game,
+                        memory_order_relaxed);
+}
+
+/*
+ * Leaf buckets (burst trie). The children of a node whose subtree holds only a
+ * few strings are not stored as a list of nodes, but as a single bucket node
+ * referred by `child`: the suffixes of those strings (all of the same length)
+ * are packed in sorted order right after the header. A bucket bursts into
+ * regular nodes once it would exceed RAX_BUCKET_MAX_SIZE suffixes or
+ * RAX_BUCKET_MAX_BYTES bytes.
+ *
+ * A bucket node is a rax_t with no child and no sibling, whose substr starts
+ * with RAX_BUCKET_MARK (never a character of the dictionary), followed by its
+ * size and suffix size (one byte each), the bitmask of its pruned suffixes
+ * (uint64_t, unaligned) and the suffixes themselves. The i-th suffix is
+ * filtered out for game g iff `filter` is g and bit i of the bitmask is set.
+ * Insertions replace a bucket with a copy one suffix larger (readers may be
+ * scanning it), so buckets are allocated with their exact size.
+ */
+#define RAX_BUCKET_MARK '\x01'
+#define RAX_BUCKET_MAX_SIZE 64
+#define RAX_BUCKET_MAX_BYTES 128
+#define RAX_BUCKET_HEADER_SIZE 11
+
+static inline bool rax_is_bucket(rax_t const *node) {
+  return node->substr[0] == RAX_BUCKET_MARK;
+}
+
+static inline size_t rax_bucket_size(rax_t const *bucket) {
+  return (unsigned char)bucket->substr[1];
+}
+
+static inline size_t rax_bucket_suffix_size(rax_t const *bucket) {
+  return (unsigned char)bucket->substr[2];
+}
+
+static inline char const *rax_bucket_suffix(rax_t const *bucket, size_t i) {
+  return bucket->substr + RAX_BUCKET_HEADER_SIZE +
+         i * rax_bucket_suffix_size(bucket);
+}
+
+static inline uint64_t rax_bucket_pruned(rax_t const *bucket) {
+  uint64_t pruned;
+  memcpy(&pruned, bucket->substr + 3, sizeof(pruned));
+  return pruned;
+}
+
+static inline void rax_bucket_set_pruned(rax_t *bucket, uint64_t pruned) {
+  memcpy(bucket->substr + 3, &pruned, sizeof(pruned));
+}
+
+/*
+ * Returns the bitmask with the lowest n bits set (n <= 64).
+ */
+static inline uint64_t rax_bucket_low_bits(size_t n) {
+  return n >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1;
+}
+
+/*
+ * Checks whether the i-th suffix of a bucket is filtered out for a game.
+ */
+static inline bool rax_bucket_is_pruned(rax_t const *bucket, size_t i,
+                                        size_t game) {
+  return bucket->filter == game && (rax_bucket_pruned(bucket) >> i) & 1;
+}
+
 /*
  * Allocates a new empty radix trie.
  * Parameters:
@@ -34,14 +141,17 @@ rax_t *rax_alloc(memory_allocator_t *allocator);
 /*
  * Searches for a string in the radix trie.
  * Parameters:
+ * - memory_allocator_t const *allocator: Allocator holding the trie
  * - rax_t *root: Root node of the trie
  * - char const *str: String to search for (null-terminated)
  * Returns: true if string is found, false otherwise
  */
-bool rax_search(rax_t const *root, char const *str);
+bool rax_search(memory_allocator_t const *allocator, rax_t const *root,
+                char const *str);
 
 /*
- * Inserts a string in the radix trie, with a given game filter.
+ * Inserts a string in the radix trie, with a given game filter. Readers may
+ * run concurrently with it (see ebr.h), but not other writers.
  * Parameters:
  * - memory_allocator_t *allocator: Pointer to the memory allocator
  * - rax_t *root: Root node of the trie
@@ -56,21 +166,296 @@ void rax_insert(memory_allocator_t *allocator, rax_t *root, char const *str,
 /*
  * Prints the strings stored in the radix trie.
  * Parameters:
+ * - memory_allocator_t const *allocator: Allocator holding the trie
  * - rax_t* root: Root node of the trie
  * - char* str: Buffer to store the printed strings (must be large enough)
  * - size_t game: Nodes (and their subtrees) with filter equal to game will be
  *     excluded from the traversal.
+ * Returns: Number of strings printed
  */
-void rax_print(rax_t const *root, char *str, size_t game);
+size_t rax_print(memory_allocator_t const *allocator, rax_t const *root,
+                 char *str, size_t game);
+
+/*
+ * Like rax_print, but formats the strings with up to `threads` threads: the
+ * children of the root are split into ranges of consecutive siblings holding
+ * about as many strings each, every thread formats a range into a buffer of
+ * its own, and the buffers are written in order, so the output is the same.
+ * Parameters:
+ * - memory_allocator_t const *allocator: Allocator holding the trie
+ * - rax_t* root: Root node of the trie
+ * - size_t k: Length of the strings
+ * - size_t game: Nodes (and their subtrees) with filter equal to game will be
+ *     excluded from the traversal.
+ * - size_t const *counts: Number of strings under each child of the root (see
+ *     update_filter), only used to balance the ranges; NULL to count them
+ * - size_t threads: Maximum number of threads
+ * Returns: Number of strings printed
+ */
+size_t rax_print_parallel(memory_allocator_t const *allocator,
+                          rax_t const *root, size_t k, size_t game,
+                          size_t const *counts, size_t threads);
 
 /*
  * Returns the number of strings stored in the radix trie.
  * Parameters:
+ * - memory_allocator_t const *allocator: Allocator holding the trie
  * - rax_t *root: Root node of the trie
  * - size_t game: Nodes (and their subtrees) with filter equal to game will not
  *     be counted
  * Returns: Number of strings in the trie
  */
-size_t rax_size(rax_t const *root, size_t game);
+size_t rax_size(memory_allocator_t const *allocator, rax_t const *root,
+                size_t game);
+
+/*
+ * Returns the game index to use for the game after `game`. Filters only have
+ * room for RAX_MAX_EPOCH game indices: when they run out, every filter in the
+ * trie is cleared (no node is filtered out at the beginning of a game anyway)
+ * and indices start again from 1; this must not run concurrently with
+ * readers.
+ * Parameters:
+ * - memory_allocator_t const *allocator: Allocator holding the trie
+ * - rax_t *root: Root node of the trie
+ * - size_t game: Index of the last game (zero if none)
+ * Returns: Index of the next game, in [1, RAX_MAX_EPOCH]
+ */
+size_t rax_next_epoch(memory_allocator_t const *allocator, rax_t *root,
+                      size_t game);
+
+/*
+ * Copies a trie into another allocator, laying its nodes out in depth-first
+ * order: each node is followed by its subtree, then by its next sibling. Hence
+ * every subtree occupies a contiguous range of memory, so that a lookup
+ * touches few pages and full traversals (update_filter, rax_print, rax_size)
+ * scan memory sequentially. Filters are copied as well.
+ * Parameters:
+ * - memory_allocator_t const *from: Allocator holding the trie
+ * - rax_t const *root: Root node of the trie
+ * - memory_allocator_t *to: Allocator to copy the trie into
+ * Returns: Root node of the copy (in `to`)
+ */
+rax_t *rax_cluster(memory_allocator_t const *from, rax_t const *root,
+                   memory_allocator_t *to);
+
+/*
+ * Bucket whose suffixes are partly pruned, in a rax_pruned_t.
+ */
+typedef struct rax_pruned_bucket_t {
+  memory_ref_t bucket;
+  uint64_t pruned;
+} rax_pruned_bucket_t;
+
+/*
+ * Strings pruned from a trie in a game, recorded as the roots of the pruned
+ * subtrees (the nodes whose filter is the game, but not their descendants)
+ * and the pruned masks of the buckets under surviving nodes. Pruning is
+ * monotonic within a game, so the state recorded after filtering with some
+ * constraints can be restored in any game whose constraints are weaker (e.g.
+ * a later game, at the same point of the same sequence of guesses), as long
+ * as the trie has not changed since (no insertion nor compaction).
+ * Members:
+ * - bool root:           Whether the root itself is pruned
+ * - size_t nodes_size:   Number of roots of pruned subtrees
+ * - size_t buckets_size: Number of partly pruned buckets
+ * - memory_ref_t *nodes: Roots of pruned subtrees (after buckets)
+ * - rax_pruned_bucket_t buckets[]: Partly pruned buckets
+ */
+typedef struct rax_pruned_t {
+  bool root;
+  size_t nodes_size;
+  size_t buckets_size;
+  memory_ref_t *nodes;
+  rax_pruned_bucket_t buckets[];
+} rax_pruned_t;
+
+/*
+ * Records the strings pruned from a trie in a game.
+ * Parameters:
+ * - memory_allocator_t const *allocator: Allocator holding the trie
+ * - rax_t const *root: Root node of the trie
+ * - size_t game: Game index
+ * Returns: Pointer to the new record (to deallocate with free)
+ */
+rax_pruned_t *rax_pruned_save(memory_allocator_t const *allocator,
+                              rax_t const *root, size_t game);
+
+/*
+ * Prunes the strings recorded by rax_pruned_save from a trie, in addition to
+ * those already pruned in the game.
+ * Parameters:
+ * - memory_allocator_t const *allocator: Allocator holding the trie
+ * - rax_t *root: Root node of the trie
+ * - rax_pruned_t const *pruned: Record of the pruned strings
+ * - size_t game: Game index
+ */
+void rax_pruned_apply(memory_allocator_t const *allocator, rax_t *root,
+                      rax_pruned_t const *pruned, size_t game);
+
+/*
+ * Returns: Number of bytes taken by a record of pruned strings
+ */
+static inline size_t rax_pruned_bytes(rax_pruned_t const *pruned) {
+  return sizeof(rax_pruned_t) +
+         pruned->buckets_size * sizeof(rax_pruned_bucket_t) +
+         pruned->nodes_size * sizeof(memory_ref_t);
+}
+
+/*
+ * Resumable iterator over the strings of a trie that a game does not prune,
+ * in sorted order and optionally restricted to a prefix. Each call to
+ * rax_iter_next yields the next page of strings: it descends from the root
+ * to the first string after the cursor (the last string yielded), skipping
+ * pruned subtrees, so it costs O(page size + depth) node visits (times the
+ * fan-out of the nodes on the path), independently of the size of the trie.
+ * Since only the cursor is kept between calls, the trie may change in
+ * between (insertions, compaction).
+ * Members:
+ * - size_t k:           Length of the strings
+ * - size_t game:        Game whose pruned strings are skipped
+ * - size_t prefix_size: Length of the prefix
+ * - bool has_cursor:    Whether a string has been yielded (or a cursor set)
+ * - bool done:          Whether all the strings have been yielded
+ * - char *prefix, *cursor, *str: Prefix, cursor and current path (k + 1
+ *     bytes each, in buffer)
+ */
+typedef struct rax_iter_t {
+  size_t k;
+  size_t game;
+  size_t prefix_size;
+  bool has_cursor;
+  bool done;
+  char *prefix;
+  char *cursor;
+  char *str;
+  char buffer[];
+} rax_iter_t;
+
+/*
+ * Allocates an iterator over strings of length k, with no game (see
+ * rax_iter_reset).
+ * Returns: Pointer to the new iterator
+ */
+rax_iter_t *rax_iter_alloc(size_t k);
+
+/*
+ * Restarts an iterator from the first string.
+ * Parameters:
+ * - rax_iter_t *it: Pointer to the iterator
+ * - size_t game: Game whose pruned strings are skipped (as in rax_print)
+ * - char const *prefix: Only the strings starting with it are yielded (at
+ *     most k characters, "" for all of them)
+ */
+void rax_iter_reset(rax_iter_t *it, size_t game, char const *prefix);
+
+/*
+ * Resumes an iterator after a cursor saved from rax_iter_cursor, keeping its
+ * game and prefix.
+ * Parameters:
+ * - rax_iter_t *it: Pointer to the iterator
+ * - char const *cursor: String of length k; the next string yielded is the
+ *     first one greater than it
+ */
+void rax_iter_seek(rax_iter_t *it, char const *cursor);
+
+/*
+ * Returns: The last string yielded by an iterator (or set by rax_iter_seek),
+ *   NULL if there is none
+ */
+static inline char const *rax_iter_cursor(rax_iter_t const *it) {
+  return it->has_cursor ? it->cursor : NULL;
+}
+
+/*
+ * Returns: true if an iterator has yielded all its strings
+ */
+static inline bool rax_iter_done(rax_iter_t const *it) { return it->done; }
+
+/*
+ * Yields the next page of strings.
+ * Parameters:
+ * - memory_allocator_t const *allocator: Allocator holding the trie
+ * - rax_t const *root: Root node of the trie
+ * - rax_iter_t *it: Pointer to the iterator
+ * - char *words: Buffer of n * (k + 1) bytes, receiving the strings (each one
+ *     followed by '\0')
+ * - size_t n: Maximum number of strings to yield
+ * Returns: Number of strings yielded (less than n only if it->done)
+ */
+size_t rax_iter_next(memory_allocator_t const *allocator, rax_t const *root,
+                     rax_iter_t *it, char *words, size_t n);
+
+/*
+ * Deallocates an iterator.
+ */
+void rax_iter_dealloc(rax_iter_t *it);
+
+/*
+ * Histograms of rax_stats_t are indexed by depth (in nodes, the root being at
+ * depth 0), label length and fan-out; larger values are counted in the last
+ * entry.
+ */
+#define RAX_STATS_MAX_DEPTH 64
+#define RAX_STATS_MAX_LABEL 32
+#define RAX_STATS_MAX_FANOUT 64
+
+/*
+ * Shape of a trie.
+ * Members:
+ * - size_t strings:        Number of strings
+ * - size_t nodes:          Number of regular nodes (the root included)
+ * - size_t buckets:        Number of buckets
+ * - size_t header_bytes:   Bytes taken by node headers (RAX_HEADER_SIZE, plus
+ *     RAX_BUCKET_HEADER_SIZE for buckets)
+ * - size_t label_bytes:    Bytes taken by labels, terminators included
+ * - size_t suffix_bytes:   Bytes taken by the suffixes stored in buckets
+ * - size_t padding_bytes:  Bytes lost rounding nodes up to MEMORY_ALIGNMENT
+ * - size_t label_length[]: Number of regular nodes per label length
+ * - size_t bucket_size[]:  Number of buckets per number of suffixes
+ * - size_t fanout[]:       Number of internal nodes per number of children
+ *     (the suffixes of a bucket child count as children)
+ * - size_t depth_nodes[]:  Number of regular nodes per depth
+ * - size_t depth_children[]: Number of children of the nodes at each depth
+ * - size_t leaf_depth[]:   Number of strings per depth of their leaf (the
+ *     suffixes of a bucket child of a node at depth d are at depth d + 1)
+ * - size_t depth_pruned[]: Number of nodes and bucket suffixes per depth that
+ *     the game prunes, not counting the descendants of pruned nodes
+ */
+typedef struct rax_stats_t {
+  size_t strings;
+  size_t nodes;
+  size_t buckets;
+  size_t header_bytes;
+  size_t label_bytes;
+  size_t suffix_bytes;
+  size_t padding_bytes;
+  size_t label_length[RAX_STATS_MAX_LABEL + 1];
+  size_t bucket_size[RAX_BUCKET_MAX_SIZE + 1];
+  size_t fanout[RAX_STATS_MAX_FANOUT + 1];
+  size_t depth_nodes[RAX_STATS_MAX_DEPTH];
+  size_t depth_children[RAX_STATS_MAX_DEPTH];
+  size_t leaf_depth[RAX_STATS_MAX_DEPTH];
+  size_t depth_pruned[RAX_STATS_MAX_DEPTH];
+} rax_stats_t;
+
+/*
+ * Walks a trie and fills in its statistics.
+ * Parameters:
+ * - memory_allocator_t const *allocator: Allocator holding the trie
+ * - rax_t const *root: Root node of the trie
+ * - size_t game: Game whose pruned nodes are counted (zero if none)
+ * - rax_stats_t *stats: Statistics to fill in
+ */
+void rax_stats(memory_allocator_t const *allocator, rax_t const *root,
+               size_t game, rax_stats_t *stats);
+
+/*
+ * Prints the statistics of a trie as a human-readable report: totals, memory
+ * breakdown, and histograms (zero entries omitted).
+ * Parameters:
+ * - FILE *out: File to print to
+ * - rax_stats_t const *stats: Statistics filled in by rax_stats
+ */
+void rax_stats_print(FILE *out, rax_stats_t const *stats);
 
 #endif
@@ -0,0 +1,75 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "trace.h"
+
+trace_t *trace_buffer = NULL;
+
+void trace_start(size_t capacity) {
+  trace_buffer =
+      (trace_t *)malloc(sizeof(trace_t) + capacity * sizeof(trace_event_t));
+  trace_buffer->capacity = capacity;
+  trace_buffer->count = 0;
+}
+
+uint64_t trace_now(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+void trace_record(char const *name, uint64_t start, char const *arg0_name,
+                  size_t arg0, char const *arg1_name, size_t arg1) {
+  uint64_t end = trace_now();
+  trace_event_t *event =
+      &trace_buffer->events[trace_buffer->count++ % trace_buffer->capacity];
+
+  event->name = name;
+  event->start = start;
+  event->duration = end - start;
+  event->arg_names[0] = arg0_name;
+  event->args[0] = arg0;
+  event->arg_names[1] = arg1_name;
+  event->args[1] = arg1;
+}
+
+void trace_dump(FILE *out) {
+  size_t capacity = trace_buffer->capacity;
+  size_t count = trace_buffer->count;
+  size_t first = count > capacity ? count - capacity : 0;
+  uint64_t origin = UINT64_MAX;
+
+  // timestamps are in microseconds from the earliest span kept (spans are
+  // recorded when they end, so it is not necessarily the first one)
+  for (size_t i = first; i < count; i++) {
+    if (trace_buffer->events[i % capacity].start < origin)
+      origin = trace_buffer->events[i % capacity].start;
+  }
+
+  fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  for (size_t i = first; i < count; i++) {
+    trace_event_t const *event = &trace_buffer->events[i % capacity];
+
+    fprintf(out,
+            "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+            "\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+            i == first ? "" : ",", event->name,
+            (double)(event->start - origin) / 1000,
+            (double)event->duration / 1000);
+    for (size_t j = 0; j < TRACE_MAX_ARGS && event->arg_names[j] != NULL;
+         j++) {
+      fprintf(out, "%s\"%s\":%zu", j == 0 ? "" : ",", event->arg_names[j],
+              event->args[j]);
+    }
+    fprintf(out, "}}");
+  }
+  fprintf(out, "\n]}\n");
+
+  free(trace_buffer);
+  trace_buffer = NULL;
+}
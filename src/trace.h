@@ -0,0 +1,111 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Event tracing. Spans (a name, a start time, a duration and up to
+ * TRACE_MAX_ARGS named integer arguments) are recorded into a ring buffer
+ * allocated once by trace_start, which keeps the last `capacity` of them, and
+ * dumped as Chrome trace JSON (chrome://tracing, Perfetto). Spans nest by
+ * time: a span recorded around a command contains the spans of its phases.
+ *
+ * While tracing is off, trace_begin and trace_end only compare a global
+ * pointer with NULL.
+ */
+#define TRACE_MAX_ARGS 2
+#define TRACE_DEFAULT_CAPACITY ((size_t)1 << 16)
+
+/*
+ * Recorded span.
+ * Members:
+ * - char const *name:        Name of the span (a string literal)
+ * - uint64_t start:          Start time, in nanoseconds
+ * - uint64_t duration:       Duration, in nanoseconds
+ * - char const *arg_names[]: Names of the arguments (NULL if unused)
+ * - size_t args[]:           Values of the arguments
+ */
+typedef struct trace_event_t {
+  char const *name;
+  uint64_t start;
+  uint64_t duration;
+  char const *arg_names[TRACE_MAX_ARGS];
+  size_t args[TRACE_MAX_ARGS];
+} trace_event_t;
+
+/*
+ * Ring buffer of spans.
+ * Members:
+ * - size_t capacity:        Number of events the buffer can hold
+ * - size_t count:           Number of events recorded so far (event i is in
+ *     events[i % capacity], unless it has been overwritten)
+ * - trace_event_t events[]: The buffer
+ */
+typedef struct trace_t {
+  size_t capacity;
+  size_t count;
+  trace_event_t events[];
+} trace_t;
+
+// buffer the events are recorded into, NULL while tracing is off
+extern trace_t *trace_buffer;
+
+/*
+ * Turns tracing on.
+ * Parameters:
+ * - size_t capacity: Number of events kept (the most recent ones)
+ */
+void trace_start(size_t capacity);
+
+/*
+ * Writes the events kept as Chrome trace JSON, and turns tracing off.
+ * Parameters:
+ * - FILE *out: File to write to
+ */
+void trace_dump(FILE *out);
+
+/*
+ * Returns: The current time in nanoseconds, from an arbitrary origin
+ */
+uint64_t trace_now(void);
+
+/*
+ * Appends a span ending now to the buffer (see trace_end).
+ */
+void trace_record(char const *name, uint64_t start, char const *arg0_name,
+                  size_t arg0, char const *arg1_name, size_t arg1);
+
+/*
+ * Returns: true if tracing is on, e.g. to only compute the arguments of a
+ *   span that cost more than that test
+ */
+static inline bool trace_enabled(void) { return trace_buffer != NULL; }
+
+/*
+ * Marks the beginning of a span.
+ * Returns: Start time to pass to trace_end (0 if tracing is off)
+ */
+static inline uint64_t trace_begin(void) {
+  return trace_buffer == NULL ? 0 : trace_now();
+}
+
+/*
+ * Marks the end of a span, recording it if tracing is on.
+ * Parameters:
+ * - char const *name: Name of the span (a string literal)
+ * - uint64_t start: Value returned by trace_begin
+ * - char const *arg0_name, *arg1_name: Names of the arguments (string
+ *     literals), or NULL
+ * - size_t arg0, arg1: Values of the arguments
+ */
+static inline void trace_end(char const *name, uint64_t start,
+                             char const *arg0_name, size_t arg0,
+                             char const *arg1_name, size_t arg1) {
+  if (trace_buffer != NULL)
+    trace_record(name, start, arg0_name, arg0, arg1_name, arg1);
+}
+
+#endif // TRACE_H
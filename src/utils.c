@@ -1,38 +1,48 @@
 #include "utils.h"
 #include "constants.h"
 
-void gen_constraint(char const *ref, char const *guess, char *feedback,
-                    size_t k) {
-  size_t ref_occur_not_perfect_match[ALPHABET_SIZE] = {0};
-
-  // first loop: finds perfect matches and puts a '+' in feedback and
-  // counts occurrences of non-perfect-matched characters in ref
-  for (size_t i = 0; i < k; i++) {
-    ref_occur_not_perfect_match[char_index(ref[i])]++;
-
-    if (ref[i] == guess[i]) {
-      feedback[i] = PERFECT_MATCH;
-      ref_occur_not_perfect_match[char_index(ref[i])]--;
-    } else {
-      feedback[i] =
-          '\0'; // not the actual value, just a filler != PERFECT_MATCH
-    }
+/*
+ * Defines the gen_constraint kernel NAME, whose loops run over exactly K
+ * characters. K is either a literal (fixed-k kernels) or the run-time
+ * parameter `k`.
+ */
+#define DEFINE_GEN_CONSTRAINT(NAME, K)                                         \
+  void NAME(char const *ref, char const *guess, char *feedback, size_t k) {    \
+    size_t ref_occur_not_perfect_match[ALPHABET_SIZE] = {0};                   \
+    (void)k;                                                                   \
+                                                                               \
+    /* first loop: finds perfect matches and puts a '+' in feedback and */     \
+    /* counts occurrences of non-perfect-matched characters in ref */          \
+    UNROLL for (size_t i = 0; i < (K); i++) {                                  \
+      if (ref[i] == guess[i]) {                                                \
+        feedback[i] = PERFECT_MATCH;                                           \
+      } else {                                                                 \
+        ref_occur_not_perfect_match[char_index(ref[i])]++;                     \
+        /* not the actual value, just a filler != PERFECT_MATCH */             \
+        feedback[i] = '\0';                                                    \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    /* second loop: takes care of filling feedback with '|' and '/' for */     \
+    /* mismatched characters between guess and ref */                          \
+    UNROLL for (size_t i = 0; i < (K); i++) {                                  \
+      if (feedback[i] == PERFECT_MATCH)                                        \
+        continue;                                                              \
+                                                                               \
+      size_t index = char_index(guess[i]);                                     \
+      if (ref_occur_not_perfect_match[index] != 0) {                           \
+        feedback[i] = PARTIAL_MATCH;                                           \
+        ref_occur_not_perfect_match[index]--;                                  \
+      } else {                                                                 \
+        feedback[i] = NO_MATCH;                                                \
+      }                                                                        \
+    }                                                                          \
+                                                                               \
+    feedback[(K)] = '\0';                                                      \
   }
 
-  // second loop: takes care of filling feedback with '|' and '/' for
-  // mismatched characters between guess and ref
-  for (size_t i = 0; i < k; i++) {
-    if (feedback[i] == PERFECT_MATCH)
-      continue;
-
-    size_t index = char_index(guess[i]);
-    if (ref_occur_not_perfect_match[index] != 0) {
-      feedback[i] = PARTIAL_MATCH;
-      ref_occur_not_perfect_match[index]--;
-    } else {
-      feedback[i] = NO_MATCH;
-    }
-  }
+#define DEFINE_FIXED_GEN_CONSTRAINT(K)                                         \
+  DEFINE_GEN_CONSTRAINT(gen_constraint_##K, K)
 
-  feedback[k] = '\0';
-}
+DEFINE_GEN_CONSTRAINT(gen_constraint, k)
+FOR_EACH_FIXED_K(DEFINE_FIXED_GEN_CONSTRAINT)
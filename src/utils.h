@@ -7,6 +7,23 @@
 
 #include "constants.h"
 
+/*
+ * Word lengths for which specialized kernels are generated at compile time.
+ * X is invoked once per length, e.g. FOR_EACH_FIXED_K(DEFINE_KERNELS).
+ */
+#define FOR_EACH_FIXED_K(X)                                                    \
+  X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15) X(16)
+
+/*
+ * Asks the compiler to fully unroll the following loop when its trip count is
+ * a compile-time constant (as in the fixed-k kernels).
+ */
+#if defined(__GNUC__)
+#define UNROLL _Pragma("GCC unroll 16")
+#else
+#define UNROLL
+#endif
+
 /*
  * Converts a character to its corresponding index in the alphabet [0, 64).
  * Parameters:
@@ -68,4 +85,15 @@ static inline void substring_copy(char *dest, char const *source, size_t a,
 void gen_constraint(char const *ref, char const *guess, char *feedback,
                     size_t k);
 
+/*
+ * Versions of gen_constraint specialized for the word lengths listed in
+ * FOR_EACH_FIXED_K: gen_constraint_K ignores its last parameter and assumes
+ * k == K.
+ */
+#define DECLARE_FIXED_GEN_CONSTRAINT(K)                                        \
+  void gen_constraint_##K(char const *ref, char const *guess, char *feedback,  \
+                          size_t k);
+FOR_EACH_FIXED_K(DECLARE_FIXED_GEN_CONSTRAINT)
+#undef DECLARE_FIXED_GEN_CONSTRAINT
+
 #endif
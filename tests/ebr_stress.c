@@ -0,0 +1,281 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include "ebr.h"
+#include "memory_allocator.h"
+#include "rax.h"
+
+/*
+ * Stress test of the readers of a trie running while a writer inserts into it
+ * (see ebr.h): a reclamation domain is attached to the allocator, and
+ * SEARCHERS threads calling rax_search and a thread calling rax_print, each
+ * between ebr_enter and ebr_exit, run while a batch of BATCH strings is
+ * inserted into a trie of INITIAL strings.
+ *
+ * Inserts are published one at a time, so a reader overlapping the batch sees
+ * the dictionary before the batch plus some of its strings. The test checks
+ * that:
+ * - rax_search finds every string of the dictionary before the batch, and no
+ *   string missing from the dictionary after it (strings of the batch may be
+ *   found or not);
+ * - every listing printed by rax_print is sorted and made of whole strings of
+ *   the dictionary after the batch, including all the strings before it, and
+ *   does not shrink from one listing to the next;
+ * - once the batch is over, the listings are the dictionary after the batch.
+ *
+ * The strings are long and over a small alphabet, so that inserts split nodes
+ * and burst buckets, whose old versions are retired while readers may hold
+ * them. Exits with a nonzero status on the first failed check.
+ */
+#define K 8
+#define INITIAL 20000
+#define BATCH 200000
+#define ABSENT 20000
+#define SEARCHERS 3
+#define PRINTS_AFTER 2
+
+/*
+ * Shared state of the test.
+ * Members:
+ * - memory_allocator_t *allocator, rax_t *dict: The trie
+ * - ebr_t *ebr:         Reclamation domain of the allocator
+ * - char *words:        INITIAL strings inserted before the batch, then the
+ *     BATCH strings of the batch, then ABSENT strings never inserted (K + 1
+ *     bytes each)
+ * - char *before, *after: Strings before and after the batch, sorted
+ * - _Atomic bool done:  Whether the batch is over
+ * - _Atomic size_t searches, prints: Reads completed during the batch
+ * - _Atomic bool failed: Whether a check failed
+ */
+typedef struct stress_t {
+  memory_allocator_t *allocator;
+  rax_t *dict;
+  ebr_t *ebr;
+  char *words;
+  char *before;
+  char *after;
+  _Atomic bool done;
+  _Atomic size_t searches;
+  _Atomic size_t prints;
+  _Atomic bool failed;
+} stress_t;
+
+/*
+ * Position of a listing in the standard output (redirected to a file).
+ */
+typedef struct listing_t {
+  long start;
+  long end;
+  bool after_batch;
+} listing_t;
+
+/*
+ * Writes the i-th string: distinct indices give distinct strings, spread over
+ * the whole space of the strings of length K over 8 symbols.
+ */
+static void make_word(size_t i, char *word) {
+  uint32_t x = (uint32_t)(i * 2654435761u + 12345u) & ((1u << (3 * K)) - 1);
+
+  for (size_t j = 0; j < K; j++) {
+    word[j] = (char)('a' + (x & 7));
+    x >>= 3;
+  }
+  word[K] = '\0';
+}
+
+static int compare_words(void const *a, void const *b) {
+  return strcmp((char const *)a, (char const *)b);
+}
+
+static bool contains(char const *sorted, size_t size, char const *word) {
+  return bsearch(word, sorted, size, K + 1, compare_words) != NULL;
+}
+
+static void fail(stress_t *stress, char const *message, char const *word) {
+  fprintf(stderr, "ebr_stress: %s: %s\n", message, word);
+  atomic_store(&stress->failed, true);
+}
+
+static int searcher(void *arg) {
+  stress_t *stress = (stress_t *)arg;
+  size_t reader = ebr_register(stress->ebr);
+  size_t total = INITIAL + BATCH + ABSENT;
+  uint64_t seed = 88172645463325252ULL + reader;
+
+  while (!atomic_load(&stress->done) && !atomic_load(&stress->failed)) {
+    // xorshift
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    size_t i = seed % total;
+    char const *word = stress->words + i * (K + 1);
+
+    ebr_enter(stress->ebr, reader);
+    bool found = rax_search(stress->allocator, stress->dict, word);
+    ebr_exit(stress->ebr, reader);
+
+    if (i < INITIAL && !found)
+      fail(stress, "string inserted before the batch not found", word);
+    else if (i >= INITIAL + BATCH && found)
+      fail(stress, "string never inserted found", word);
+    atomic_fetch_add(&stress->searches, 1);
+  }
+
+  return 0;
+}
+
+/*
+ * Prints the trie until PRINTS_AFTER listings have been printed after the
+ * batch, recording their positions in listings (room for *size of them).
+ */
+static int printer(void *arg) {
+  void **args = (void **)arg;
+  stress_t *stress = (stress_t *)args[0];
+  listing_t **listings = (listing_t **)args[1];
+  size_t *size = (size_t *)args[2], capacity = 0, after = 0;
+  size_t reader = ebr_register(stress->ebr);
+  char str[K + 1];
+
+  while (after < PRINTS_AFTER && !atomic_load(&stress->failed)) {
+    bool after_batch = atomic_load(&stress->done);
+
+    if (*size == capacity) {
+      capacity = capacity == 0 ? 64 : 2 * capacity;
+      *listings =
+          (listing_t *)realloc(*listings, capacity * sizeof(listing_t));
+    }
+
+    // no filter equals (size_t)-1, so nothing is skipped
+    long start = ftell(stdout);
+    ebr_enter(stress->ebr, reader);
+    rax_print(stress->allocator, stress->dict, str, (size_t)-1);
+    ebr_exit(stress->ebr, reader);
+    fflush(stdout);
+
+    (*listings)[(*size)++] = (listing_t){start, ftell(stdout), after_batch};
+    after += after_batch;
+    if (!after_batch)
+      atomic_fetch_add(&stress->prints, 1);
+  }
+
+  return 0;
+}
+
+/*
+ * Checks the listings printed, read back from the file of the standard
+ * output.
+ */
+static void check_listings(stress_t *stress, FILE *out,
+                           listing_t const *listings, size_t size) {
+  char line[K + 2];
+  size_t previous = 0;
+
+  for (size_t l = 0; l < size && !atomic_load(&stress->failed); l++) {
+    size_t count = 0, before = 0;
+    char last[K + 1] = "";
+
+    fseek(out, listings[l].start, SEEK_SET);
+    while (ftell(out) < listings[l].end && fgets(line, sizeof(line), out)) {
+      size_t length = strcspn(line, "\n");
+      line[length] = '\0';
+
+      if (length != K || !contains(stress->after, INITIAL + BATCH, line)) {
+        fail(stress, "torn or unknown string printed", line);
+        return;
+      }
+      if (count > 0 && strcmp(last, line) >= 0) {
+        fail(stress, "strings printed out of order", line);
+        return;
+      }
+      before += contains(stress->before, INITIAL, line);
+      memcpy(last, line, K + 1);
+      count++;
+    }
+
+    if (before != INITIAL)
+      fail(stress, "listing misses strings inserted before the batch", last);
+    else if (count < previous)
+      fail(stress, "listing shrank", last);
+    else if (listings[l].after_batch && count != INITIAL + BATCH)
+      fail(stress, "listing after the batch misses strings", last);
+    previous = count;
+  }
+}
+
+int main(void) {
+  size_t total = INITIAL + BATCH + ABSENT;
+  stress_t stress;
+
+  // the listings go to an unlinked temporary file, read back at the end
+  char path[] = "/tmp/ebr_stress_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0 || freopen(path, "w+", stdout) == NULL) {
+    fprintf(stderr, "ebr_stress: cannot create %s\n", path);
+    return EXIT_FAILURE;
+  }
+  close(fd);
+  unlink(path);
+
+  stress.words = (char *)malloc(total * (K + 1));
+  stress.before = (char *)malloc(INITIAL * (K + 1));
+  stress.after = (char *)malloc((INITIAL + BATCH) * (K + 1));
+  for (size_t i = 0; i < total; i++)
+    make_word(i, stress.words + i * (K + 1));
+  memcpy(stress.before, stress.words, INITIAL * (K + 1));
+  memcpy(stress.after, stress.words, (INITIAL + BATCH) * (K + 1));
+  qsort(stress.before, INITIAL, K + 1, compare_words);
+  qsort(stress.after, INITIAL + BATCH, K + 1, compare_words);
+
+  stress.allocator = init_memory_allocator(1024 * K);
+  stress.dict = rax_alloc(stress.allocator);
+  for (size_t i = 0; i < INITIAL; i++)
+    rax_insert(stress.allocator, stress.dict, stress.words + i * (K + 1), K,
+               0);
+  stress.ebr = ebr_alloc(stress.allocator);
+  atomic_init(&stress.done, false);
+  atomic_init(&stress.searches, 0);
+  atomic_init(&stress.prints, 0);
+  atomic_init(&stress.failed, false);
+
+  listing_t *listings = NULL;
+  size_t listings_size = 0;
+  void *printer_args[] = {&stress, &listings, &listings_size};
+  thrd_t threads[SEARCHERS + 1];
+  for (size_t i = 0; i < SEARCHERS; i++)
+    thrd_create(&threads[i], searcher, &stress);
+  thrd_create(&threads[SEARCHERS], printer, printer_args);
+
+  // the batch, concurrent with the readers
+  for (size_t i = INITIAL; i < INITIAL + BATCH; i++)
+    rax_insert(stress.allocator, stress.dict, stress.words + i * (K + 1), K,
+               0);
+  atomic_store(&stress.done, true);
+
+  for (size_t i = 0; i <= SEARCHERS; i++)
+    thrd_join(threads[i], NULL);
+
+  fflush(stdout);
+  check_listings(&stress, stdout, listings, listings_size);
+  fprintf(stderr,
+          "ebr_stress: %zu strings inserted, %zu searches and %zu listings "
+          "during the batch, epoch %zu\n",
+          (size_t)BATCH, atomic_load(&stress.searches),
+          atomic_load(&stress.prints), atomic_load(&stress.ebr->epoch));
+
+  bool failed = atomic_load(&stress.failed);
+  ebr_dealloc(stress.ebr);
+  deallocate(stress.allocator);
+  free(listings);
+  free(stress.words);
+  free(stress.before);
+  free(stress.after);
+
+  return failed ? EXIT_FAILURE : 0;
+}